@@ -0,0 +1,233 @@
+/*
+ * Compares restacking views in a sublayer by searching the list for them
+ * (the previous implementation) with splicing at the saved list positions
+ * (the current one in workspace-impl.cpp).
+ *
+ * Usage: bench-restack [operations]
+ */
+#include <wayfire/nonstd/observer_ptr.h>
+
+#include <list>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <random>
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+
+namespace
+{
+struct fake_view_t
+{
+    /* The position in the list of the current implementation */
+    std::list<nonstd::observer_ptr<fake_view_t>>::iterator position;
+};
+
+using view_ptr = nonstd::observer_ptr<fake_view_t>;
+
+namespace baseline
+{
+/** Find a smart pointer inside a list */
+template<class Haystack, class Needle>
+typename std::list<Haystack>::iterator find_in(std::list<Haystack>& hay,
+    const Needle& needle)
+{
+    return std::find_if(std::begin(hay), std::end(hay), [=] (const auto& elem)
+    {
+        return elem.get() == needle.get();
+    });
+}
+
+/** Bring to front or lower to back inside a container of smart pointers */
+template<class Haystack, class Needle>
+void raise_to_front(std::list<Haystack>& hay, const Needle& needle,
+    bool reverse = false)
+{
+    auto it = find_in(hay, needle);
+    hay.splice(reverse ? hay.end() : hay.begin(), hay, it);
+}
+
+/** Reorder list so that @element is directly above @below. */
+template<class Haystack, class Needle>
+void reorder_above(
+    std::list<Haystack>& list, const Needle& element, const Needle& below)
+{
+    auto element_it = find_in(list, element);
+    auto pos = find_in(list, below);
+    list.splice(pos, list, element_it);
+}
+
+/** Reorder list so that @element is directly below @above. */
+template<class Haystack, class Needle>
+void reorder_below(
+    std::list<Haystack>& list, const Needle& element, const Needle& above)
+{
+    auto element_it = find_in(list, element);
+    auto pos = find_in(list, above);
+    assert(pos != list.end());
+    list.splice(std::next(pos), list, element_it);
+}
+}
+
+namespace current
+{
+/** Bring to front or lower to back the element at @element */
+template<class T>
+void raise_to_front(std::list<T>& list, typename std::list<T>::iterator element,
+    bool reverse = false)
+{
+    list.splice(reverse ? list.end() : list.begin(), list, element);
+}
+
+/** Reorder list so that @element is directly above @below. */
+template<class T>
+void reorder_above(std::list<T>& list,
+    typename std::list<T>::iterator element, typename std::list<T>::iterator below)
+{
+    list.splice(below, list, element);
+}
+
+/** Reorder list so that @element is directly below @above. */
+template<class T>
+void reorder_below(std::list<T>& list,
+    typename std::list<T>::iterator element, typename std::list<T>::iterator above)
+{
+    assert(above != list.end());
+    list.splice(std::next(above), list, element);
+}
+}
+
+enum operation_t
+{
+    RAISE,
+    REORDER_ABOVE,
+    REORDER_BELOW,
+};
+
+struct step_t
+{
+    view_ptr view;
+    view_ptr other;
+};
+
+/** @return The average time of one step, in nanoseconds */
+template<class F>
+double measure(const std::vector<step_t>& steps, F func)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (auto& step : steps)
+    {
+        func(step);
+    }
+
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(end - start).count() /
+           steps.size();
+}
+
+/**
+ * Run the same steps with both implementations on lists with the same
+ * initial order, and check that they end up in the same order.
+ */
+bool bench(operation_t operation, const char *name, int nr_views,
+    int nr_steps)
+{
+    std::vector<std::unique_ptr<fake_view_t>> views;
+    std::list<view_ptr> old_list, new_list;
+    for (int i = 0; i < nr_views; i++)
+    {
+        views.push_back(std::make_unique<fake_view_t>());
+        view_ptr view{views.back()};
+        old_list.push_back(view);
+        new_list.push_back(view);
+        view->position = std::prev(new_list.end());
+    }
+
+    std::mt19937 rng(nr_views);
+    std::uniform_int_distribution<int> pick(0, nr_views - 1);
+    std::vector<step_t> steps;
+    for (int i = 0; i < nr_steps; i++)
+    {
+        int a = pick(rng), b = pick(rng);
+        while (b == a)
+        {
+            b = pick(rng);
+        }
+
+        steps.push_back({view_ptr{views[a]}, view_ptr{views[b]}});
+    }
+
+    double old_time = measure(steps, [&] (const step_t& step)
+    {
+        switch (operation)
+        {
+          case RAISE:
+            baseline::raise_to_front(old_list, step.view);
+            break;
+
+          case REORDER_ABOVE:
+            baseline::reorder_above(old_list, step.view, step.other);
+            break;
+
+          case REORDER_BELOW:
+            baseline::reorder_below(old_list, step.view, step.other);
+            break;
+        }
+    });
+
+    double new_time = measure(steps, [&] (const step_t& step)
+    {
+        switch (operation)
+        {
+          case RAISE:
+            current::raise_to_front(new_list, step.view->position);
+            break;
+
+          case REORDER_ABOVE:
+            current::reorder_above(new_list, step.view->position,
+                step.other->position);
+            break;
+
+          case REORDER_BELOW:
+            current::reorder_below(new_list, step.view->position,
+                step.other->position);
+            break;
+        }
+    });
+
+    printf("%-14s %6d %14.1f %14.1f %9.2fx\n", name, nr_views, old_time,
+        new_time, old_time / new_time);
+
+    return old_list == new_list;
+}
+}
+
+int main(int argc, char *argv[])
+{
+    int nr_steps = argc > 1 ? std::atoi(argv[1]) : 10000;
+    if (nr_steps <= 0)
+    {
+        fprintf(stderr, "Usage: %s [operations]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    bool same = true;
+    printf("%-14s %6s %14s %14s %10s\n", "operation", "views",
+        "baseline (ns)", "current (ns)", "speedup");
+    for (int nr_views : {10, 100, 1000, 5000})
+    {
+        same &= bench(RAISE, "raise", nr_views, nr_steps);
+        same &= bench(REORDER_ABOVE, "reorder_above", nr_views, nr_steps);
+        same &= bench(REORDER_BELOW, "reorder_below", nr_views, nr_steps);
+    }
+
+    if (!same)
+    {
+        fprintf(stderr, "The implementations disagree on the stacking order\n");
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,224 @@
+/*
+ * Compares wf::safe_list_t with the std::list<std::unique_ptr<T>> based
+ * implementation it replaced, on iteration, insertion and removal.
+ *
+ * Usage: bench-safe-list [repetitions]
+ */
+#include <wayfire/nonstd/safe-list.hpp>
+
+#include <list>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <functional>
+#include <chrono>
+#include <random>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+
+namespace
+{
+/**
+ * The previous safe list, without the event loop. Erased elements are
+ * removed by cleanup(), which the benchmarks call where the event loop
+ * would have run the idle callback.
+ */
+template<class T>
+class baseline_safe_list_t
+{
+    std::list<std::unique_ptr<T>> list;
+
+  public:
+    void cleanup()
+    {
+        auto it = list.begin();
+        while (it != list.end())
+        {
+            if (*it)
+            {
+                ++it;
+            } else
+            {
+                it = list.erase(it);
+            }
+        }
+    }
+
+    void push_back(T value)
+    {
+        list.push_back(std::make_unique<T>(std::move(value)));
+    }
+
+    void for_each(std::function<void(T&)> func) const
+    {
+        auto it = list.begin();
+        for (int size = list.size(); size > 0; size--, it++)
+        {
+            if (*it)
+            {
+                func(**it);
+            }
+        }
+    }
+
+    void remove_all(const T& value)
+    {
+        remove_if([=] (const T& el) { return el == value; });
+    }
+
+    void remove_if(std::function<bool(const T&)> predicate)
+    {
+        for (auto& it : list)
+        {
+            if (it && predicate(*it))
+            {
+                auto copy = std::move(it);
+                it = nullptr;
+            }
+        }
+    }
+};
+
+template<class T>
+void cleanup(baseline_safe_list_t<T>& list)
+{
+    list.cleanup();
+}
+
+template<class T>
+void cleanup(wf::safe_list_t<T>&)
+{}
+
+/* Keeps the compiler from optimizing the benchmarked work away */
+volatile uint64_t sink;
+
+/** @return The average time of one call of @func, in nanoseconds */
+template<class F>
+double measure(int repetitions, F func)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < repetitions; i++)
+    {
+        func();
+    }
+
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(end - start).count() /
+           repetitions;
+}
+
+template<class List>
+double bench_iterate(int size, int repetitions)
+{
+    List list;
+    for (int i = 0; i < size; i++)
+    {
+        list.push_back(i);
+    }
+
+    return measure(repetitions, [&] ()
+    {
+        uint64_t sum = 0;
+        list.for_each([&] (int& value) { sum += value; });
+        sink = sum;
+    });
+}
+
+template<class List>
+double bench_insert(int size, int repetitions)
+{
+    return measure(repetitions, [&] ()
+    {
+        List list;
+        for (int i = 0; i < size; i++)
+        {
+            list.push_back(i);
+        }
+
+        uint64_t sum = 0;
+        list.for_each([&] (int& value) { sum += value; });
+        sink = sum;
+    });
+}
+
+template<class List>
+double bench_remove(int size, int repetitions)
+{
+    std::vector<int> order(size);
+    for (int i = 0; i < size; i++)
+    {
+        order[i] = i;
+    }
+
+    std::shuffle(order.begin(), order.end(), std::mt19937(size));
+    double total = 0;
+    for (int r = 0; r < repetitions; r++)
+    {
+        List list;
+        for (int i = 0; i < size; i++)
+        {
+            list.push_back(i);
+        }
+
+        /* Remove half of the elements from within an iteration, like
+         * signal handlers disconnecting themselves, then the rest outside */
+        total += measure(1, [&] ()
+        {
+            int next = 0;
+            list.for_each([&] (int&)
+            {
+                if (next < size / 2)
+                {
+                    list.remove_all(order[next++]);
+                }
+            });
+            cleanup(list);
+
+            while (next < size)
+            {
+                list.remove_all(order[next++]);
+                cleanup(list);
+            }
+        });
+    }
+
+    return total / repetitions;
+}
+
+void report(const char *name, int size, double baseline, double current)
+{
+    printf("%-8s %6d %14.1f %14.1f %8.2fx\n", name, size, baseline, current,
+        baseline / current);
+}
+}
+
+int main(int argc, char *argv[])
+{
+    int repetitions = argc > 1 ? std::atoi(argv[1]) : 1000;
+    if (repetitions <= 0)
+    {
+        fprintf(stderr, "Usage: %s [repetitions]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    using baseline_t = baseline_safe_list_t<int>;
+    using current_t  = wf::safe_list_t<int>;
+
+    printf("%-8s %6s %14s %14s %9s\n", "bench", "size", "baseline (ns)",
+        "current (ns)", "speedup");
+    for (int size : {4, 32, 256, 2048})
+    {
+        report("iterate", size, bench_iterate<baseline_t>(size, repetitions),
+            bench_iterate<current_t>(size, repetitions));
+        report("insert", size, bench_insert<baseline_t>(size, repetitions),
+            bench_insert<current_t>(size, repetitions));
+        /* Removal is quadratic in both versions */
+        int remove_repetitions = std::max(1, repetitions * 32 / size);
+        report("remove", size,
+            bench_remove<baseline_t>(size, remove_repetitions),
+            bench_remove<current_t>(size, remove_repetitions));
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -76,8 +76,8 @@ struct animation_hook : public animation_hook_base
         current_output = new_output;
     }
 
-    wf::signal_connection_t on_set_output = {[this] (wf::signal_data_t *data)
-        { set_output(view->get_output()); }
+    wf::typed_connection_t<wf::view_set_output_signal> on_set_output =
+    {[this] (wf::view_set_output_signal*) { set_output(view->get_output()); }
     };
 
     animation_hook(wayfire_view view, int duration, wf_animation_type type)
@@ -96,7 +96,7 @@ struct animation_hook : public animation_hook_base
         set_output(view->get_output());
         /* Animation is driven by the output render cycle the view is on.
          * Thus, we need to keep in sync with the current output. */
-        view->connect_signal("set-output", &on_set_output);
+        view->connect(&on_set_output);
     }
 
     void stop_hook(bool detached) override
@@ -181,6 +181,13 @@ void ParticleSystem::create_program()
     OpenGL::render_begin();
     program.set_simple(OpenGL::compile_program(particle_vert_source,
         particle_frag_source));
+
+    position_attr     = program.get_attrib("position");
+    radius_attr       = program.get_attrib("radius");
+    center_attr       = program.get_attrib("center");
+    color_attr        = program.get_attrib("color");
+    matrix_uniform    = program.get_uniform("matrix");
+    smoothing_uniform = program.get_uniform("smoothing");
     OpenGL::render_end();
 }
 
@@ -194,33 +201,33 @@ void ParticleSystem::render(glm::mat4 matrix)
         -1, 1
     };
 
-    program.attrib_pointer("position", 2, 0, vertex_data);
-    program.attrib_divisor("position", 0);
+    program.attrib_pointer(position_attr, 2, 0, vertex_data);
+    program.attrib_divisor(position_attr, 0);
 
-    program.attrib_pointer("radius", 1, 0, radius.data());
-    program.attrib_divisor("radius", 1);
+    program.attrib_pointer(radius_attr, 1, 0, radius.data());
+    program.attrib_divisor(radius_attr, 1);
 
-    program.attrib_pointer("center", 2, 0, center.data());
-    program.attrib_divisor("center", 1);
+    program.attrib_pointer(center_attr, 2, 0, center.data());
+    program.attrib_divisor(center_attr, 1);
 
     // matrix
-    program.uniformMatrix4f("matrix", matrix);
+    program.uniformMatrix4f(matrix_uniform, matrix);
 
     /* Darken the background */
-    program.attrib_pointer("color", 4, 0, dark_color.data());
-    program.attrib_divisor("color", 1);
+    program.attrib_pointer(color_attr, 4, 0, dark_color.data());
+    program.attrib_divisor(color_attr, 1);
 
     GL_CALL(glEnable(GL_BLEND));
     GL_CALL(glBlendFunc(GL_ZERO, GL_ONE_MINUS_SRC_ALPHA));
-    program.uniform1f("smoothing", 0.7);
+    program.uniform1f(smoothing_uniform, 0.7);
 
     // TODO: optimize shaders for this case
     GL_CALL(glDrawArraysInstanced(GL_TRIANGLE_FAN, 0, 4, ps.size()));
 
     // particle color
-    program.attrib_pointer("color", 4, 0, color.data());
+    program.attrib_pointer(color_attr, 4, 0, color.data());
     GL_CALL(glBlendFunc(GL_SRC_ALPHA, GL_ONE));
-    program.uniform1f("smoothing", 0.5);
+    program.uniform1f(smoothing_uniform, 0.5);
     GL_CALL(glDrawArraysInstanced(GL_TRIANGLE_FAN, 0, 4, ps.size()));
 
     GL_CALL(glDisable(GL_BLEND));
@@ -77,6 +77,9 @@ class ParticleSystem
     std::vector<float> center;
 
     OpenGL::program_t program;
+    OpenGL::program_location_t position_attr, radius_attr, center_attr,
+        color_attr, matrix_uniform, smoothing_uniform;
+
     void exec_worker_threads(std::function<void(int, int)> spawn_worker);
     void update_worker(float time, int start, int end);
     void create_program();
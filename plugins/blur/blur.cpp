@@ -198,13 +198,17 @@ class wayfire_blur : public wf::plugin_interface_t
         return padded;
     }
 
-    // Blur region for current frame
+    // Blur region for current frame, without sticky views
     wf::region_t blur_region;
+    // Blur region of sticky views, relative to the current workspace. Sticky
+    // views are visible on all workspaces, so it is repeated on each of them.
+    wf::region_t sticky_blur_region;
 
     void update_blur_region()
     {
         blur_region.clear();
-        auto views = output->workspace->get_views_in_layer(wf::ALL_LAYERS);
+        sticky_blur_region.clear();
+        auto views = output->workspace->get_stacking_order(wf::ALL_LAYERS);
 
         for (auto& view : views)
         {
@@ -219,23 +223,36 @@ class wayfire_blur : public wf::plugin_interface_t
                 blur_region |= bbox;
             } else
             {
-                auto wsize = output->workspace->get_workspace_grid_size();
-                for (int i = 0; i < wsize.width; i++)
-                {
-                    for (int j = 0; j < wsize.height; j++)
-                    {
-                        blur_region |=
-                            bbox + wf::origin(output->render->get_ws_box({i, j}));
-                    }
-                }
+                sticky_blur_region |= bbox;
             }
         }
     }
 
+    /** Find the part of the given region which contains blurred views */
+    wf::region_t get_blur_region(const wf::region_t& region) const
+    {
+        wf::region_t result = region & blur_region;
+        if (sticky_blur_region.empty() || region.empty())
+        {
+            return result;
+        }
+
+        /* Add the copies of the sticky views only on the workspaces which
+         * the region overlaps */
+        auto extents = wlr_box_from_pixman_box(region.get_extents());
+        for (auto ws : output->workspace->get_workspace_range(extents))
+        {
+            auto ws_box = output->render->get_ws_box(ws);
+            result |= region & ws_box & (sticky_blur_region + wf::origin(ws_box));
+        }
+
+        return result;
+    }
+
     /** Find the region of blurred views on the given workspace */
     wf::region_t get_blur_region(wf::point_t ws) const
     {
-        return blur_region & output->render->get_ws_box(ws);
+        return get_blur_region(wf::region_t{output->render->get_ws_box(ws)});
     }
 
   public:
@@ -324,7 +341,7 @@ class wayfire_blur : public wf::plugin_interface_t
                 padding);
 
             output->render->damage(expand_region(
-                damage & this->blur_region, fb.scale));
+                get_blur_region(damage), fb.scale));
         };
         output->render->add_effect(&frame_pre_paint, wf::OUTPUT_EFFECT_DAMAGE);
 
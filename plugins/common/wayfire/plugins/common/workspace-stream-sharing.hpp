@@ -1,5 +1,6 @@
 #pragma once
 
+#include <algorithm>
 #include <wayfire/nonstd/noncopyable.hpp>
 #include <wayfire/object.hpp>
 #include <wayfire/output.hpp>
@@ -7,6 +8,7 @@
 #include <wayfire/render-manager.hpp>
 #include <wayfire/workspace-stream.hpp>
 #include <wayfire/workspace-manager.hpp>
+#include <wayfire/option-wrapper.hpp>
 
 namespace wf
 {
@@ -15,6 +17,12 @@ namespace wf
  *
  * Using this interface allows all plugins to use the same OpenGL textures for
  * the workspaces, thereby reducing the memory overhead of a workspace stream.
+ *
+ * If core/prewarm_workspace_streams is enabled, the streams of the current
+ * workspace and the workspaces around it are kept running and are updated in
+ * the background, so that they are ready when a plugin starts showing them.
+ * The render manager decides when there is time for this, see the
+ * workspace-stream-prewarm signal.
  */
 class workspace_stream_pool_t : public noncopyable_t, public wf::custom_data_t
 {
@@ -77,15 +85,20 @@ class workspace_stream_pool_t : public noncopyable_t, public wf::custom_data_t
      * Update the contents of the given workspace.
      *
      * If the workspace has not been started before, it will be started.
+     *
+     * @param scale The scale at which the workspace is going to be shown,
+     *   see render_manager::workspace_stream_update().
      */
-    void update(wf::point_t workspace)
+    void update(wf::point_t workspace, float scale = 1.0)
     {
         auto& stream = get(workspace);
+        held[workspace.x][workspace.y] = true;
         if (stream.running)
         {
-            output->render->workspace_stream_update(stream);
+            output->render->workspace_stream_update(stream, scale, scale);
         } else
         {
+            stream.scale_x = stream.scale_y = scale;
             output->render->workspace_stream_start(stream);
         }
     }
@@ -96,7 +109,8 @@ class workspace_stream_pool_t : public noncopyable_t, public wf::custom_data_t
     void stop(wf::point_t workspace)
     {
         auto& stream = get(workspace);
-        if (stream.running)
+        held[workspace.x][workspace.y] = false;
+        if (stream.running && !is_prewarmed(workspace))
         {
             output->render->workspace_stream_stop(stream);
         }
@@ -109,14 +123,31 @@ class workspace_stream_pool_t : public noncopyable_t, public wf::custom_data_t
 
         auto wsize = this->output->workspace->get_workspace_grid_size();
         this->streams.resize(wsize.width);
+        this->held.resize(wsize.width);
         for (int i = 0; i < wsize.width; i++)
         {
             this->streams[i].resize(wsize.height);
+            this->held[i].resize(wsize.height, false);
             for (int j = 0; j < wsize.height; j++)
             {
                 this->streams[i][j].ws = {i, j};
             }
         }
+
+        output->render->connect_signal("workspace-stream-enumerate",
+            &on_enumerate);
+        output->render->connect_signal("workspace-stream-prewarm", &on_prewarm);
+        prewarm_streams.set_callback([=] ()
+        {
+            if (prewarm_streams)
+            {
+                /* Get a frame, after which pre-warming can start */
+                output->render->schedule_redraw();
+            } else
+            {
+                stop_unused_streams();
+            }
+        });
     }
 
     /** Number of active users of this instance */
@@ -124,5 +155,117 @@ class workspace_stream_pool_t : public noncopyable_t, public wf::custom_data_t
 
     wf::output_t *output;
     std::vector<std::vector<wf::workspace_stream_t>> streams;
+    wf::signal_connection_t on_enumerate = [=] (wf::signal_data_t *data)
+    {
+        auto ev = static_cast<wf::stream_enumerate_signal_t*>(data);
+        for (auto& row : this->streams)
+        {
+            for (auto& stream : row)
+            {
+                ev->streams.push_back(&stream);
+            }
+        }
+    };
+
+    /* Whether the stream is used by a plugin, i.e updated and not stopped */
+    std::vector<std::vector<bool>> held;
+
+    wf::option_wrapper_t<bool> prewarm_streams{"core/prewarm_workspace_streams"};
+    wf::signal_connection_t on_prewarm = [=] (wf::signal_data_t *data)
+    {
+        auto ev = static_cast<wf::stream_prewarm_signal_t*>(data);
+        ev->pending |= prewarm();
+    };
+
+    /**
+     * Whether the given workspace is at most one workspace away from the
+     * current one, in each direction.
+     */
+    bool is_prewarmed(wf::point_t workspace) const
+    {
+        if (!prewarm_streams)
+        {
+            return false;
+        }
+
+        auto current = output->workspace->get_current_workspace();
+
+        return std::abs(workspace.x - current.x) <= 1 &&
+               std::abs(workspace.y - current.y) <= 1;
+    }
+
+    /**
+     * Stop the streams which are neither pre-warmed nor held. Their buffers
+     * are kept, so that they can be shown again quickly, until the render
+     * manager releases them.
+     */
+    void stop_unused_streams()
+    {
+        for (auto& row : this->streams)
+        {
+            for (auto& stream : row)
+            {
+                if (stream.running && !is_prewarmed(stream.ws) &&
+                    !held[stream.ws.x][stream.ws.y])
+                {
+                    output->render->workspace_stream_stop(stream);
+                }
+            }
+        }
+    }
+
+    /**
+     * Update the pre-warmed stream with pending damage which was least
+     * recently updated, and stop the streams which are neither pre-warmed nor
+     * held.
+     *
+     * At most one stream is repainted each time, so that pre-warming does not
+     * take longer than about one repaint of the output.
+     *
+     * @return Whether a stream was repainted, in which case others may still
+     *   have pending damage.
+     */
+    bool prewarm()
+    {
+        stop_unused_streams();
+        if (!prewarm_streams)
+        {
+            return false;
+        }
+
+        std::vector<wf::workspace_stream_t*> prewarmed;
+        for (auto& row : this->streams)
+        {
+            for (auto& stream : row)
+            {
+                if (is_prewarmed(stream.ws))
+                {
+                    prewarmed.push_back(&stream);
+                }
+            }
+        }
+
+        std::sort(prewarmed.begin(), prewarmed.end(), [] (auto a, auto b)
+        {
+            return a->last_frame < b->last_frame;
+        });
+
+        for (auto stream : prewarmed)
+        {
+            if (!stream->running)
+            {
+                output->render->workspace_stream_start(*stream);
+                return true;
+            }
+
+            if (output->render->workspace_stream_update(*stream,
+                stream->scale_x, stream->scale_y))
+            {
+                return true;
+            }
+        }
+
+        return false;
+    }
 };
 }
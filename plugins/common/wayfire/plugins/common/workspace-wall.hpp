@@ -10,7 +10,9 @@ namespace wf
  * When the workspace wall is rendered via a render hook, the frame event
  * is emitted on each frame.
  *
- * The target framebuffer is passed as signal data.
+ * The target framebuffer is passed as signal data. Listeners which draw on
+ * top of the wall should report what they draw with
+ * render_manager::report_renderer_damage().
  */
 struct wall_frame_event_t : public signal_data_t
 {
@@ -32,6 +34,7 @@ class workspace_wall_t : public wf::signal_provider_t
     {
         this->viewport = get_wall_rectangle();
         streams = workspace_stream_pool_t::ensure_pool(output);
+        output->render->connect_signal("workspace-stream-pre", &on_stream_pre);
     }
 
     ~workspace_wall_t()
@@ -48,6 +51,7 @@ class workspace_wall_t : public wf::signal_provider_t
     void set_background_color(const wf::color_t& color)
     {
         this->background_color = color;
+        this->damage_all = true;
     }
 
     /**
@@ -59,6 +63,7 @@ class workspace_wall_t : public wf::signal_provider_t
     void set_gap_size(int size)
     {
         this->gap_size = size;
+        this->damage_all = true;
     }
 
     /**
@@ -90,6 +95,11 @@ class workspace_wall_t : public wf::signal_provider_t
             }
         }
 
+        if (this->viewport != viewport_geometry)
+        {
+            this->damage_all = true;
+        }
+
         this->viewport = viewport_geometry;
     }
 
@@ -102,7 +112,11 @@ class workspace_wall_t : public wf::signal_provider_t
      */
     void render_wall(const wf::framebuffer_t& fb, wf::geometry_t geometry)
     {
-        update_streams();
+        /* Workspaces are shown scaled down by the same factor as the viewport,
+         * so their streams do not need to be rendered at full resolution */
+        float scale = std::max(geometry.width * 1.0 / viewport.width,
+            geometry.height * 1.0 / viewport.height);
+        update_streams(scale);
 
         OpenGL::render_begin(fb);
         fb.logic_scissor(geometry);
@@ -137,6 +151,7 @@ class workspace_wall_t : public wf::signal_provider_t
         {
             this->output->render->set_renderer(on_render);
             render_hook_set = true;
+            damage_all = true;
         }
     }
 
@@ -203,12 +218,16 @@ class workspace_wall_t : public wf::signal_provider_t
     wf::geometry_t viewport = {0, 0, 0, 0};
     nonstd::observer_ptr<workspace_stream_pool_t> streams;
 
-    /** Update or start visible streams */
-    void update_streams()
+    /**
+     * Update or start visible streams
+     *
+     * @param scale The scale at which the workspaces are shown.
+     */
+    void update_streams(float scale)
     {
         for (auto& ws : get_visible_workspaces(viewport))
         {
-            streams->update(ws);
+            streams->update(ws, scale);
         }
     }
 
@@ -276,10 +295,79 @@ class workspace_wall_t : public wf::signal_provider_t
         return translation * scaling;
     }
 
+    /**
+     * Convert a box from workspace wall coordinates to the coordinates of the
+     * rectangle the viewport is rendered to, rounding outwards.
+     */
+    wf::geometry_t wall_box_to_target(const wf::geometry_t& box,
+        const wf::geometry_t& target) const
+    {
+        const double scale_x = target.width * 1.0 / viewport.width;
+        const double scale_y = target.height * 1.0 / viewport.height;
+
+        int x1 = std::floor(target.x + (box.x - viewport.x) * scale_x);
+        int y1 = std::floor(target.y + (box.y - viewport.y) * scale_y);
+        int x2 = std::ceil(target.x + (box.x + box.width - viewport.x) * scale_x);
+        int y2 = std::ceil(target.y + (box.y + box.height - viewport.y) * scale_y);
+
+        return {x1, y1, x2 - x1, y2 - y1};
+    }
+
+    /* Whether the whole wall has to be repainted in the next frame */
+    bool damage_all = true;
+    /* Damage of the visible workspaces in the current frame, in output-local
+     * coordinates. Collected only while the wall renders as a render hook. */
+    wf::region_t frame_damage;
+    bool collect_damage = false;
+
+    wf::signal_connection_t on_stream_pre = [=] (wf::signal_data_t *data)
+    {
+        if (!collect_damage || (viewport.width <= 0) || (viewport.height <= 0))
+        {
+            return;
+        }
+
+        auto ev = static_cast<wf::stream_signal_t*>(data);
+        auto ws_box = get_workspace_rectangle(ev->ws);
+        auto target = this->output->get_relative_geometry();
+
+        /* The damage is relative to the current workspace */
+        wf::point_t to_wall = {
+            ws_box.x - ev->fb.geometry.x,
+            ws_box.y - ev->fb.geometry.y,
+        };
+
+        for (const auto& rect : ev->raw_damage)
+        {
+            auto box = wlr_box_from_pixman_box(rect);
+            box.x += to_wall.x;
+            box.y += to_wall.y;
+            frame_damage |= wall_box_to_target(box, target);
+        }
+    };
+
     bool render_hook_set = false;
     wf::render_hook_t on_render = [=] (const wf::framebuffer_t& target)
     {
+        frame_damage.clear();
+        collect_damage = !damage_all;
+        damage_all     = false;
+
         render_wall(target, this->output->get_relative_geometry());
+        if (collect_damage)
+        {
+            /* Only the workspaces' contents changed, the layout of the wall
+             * is the same as in the previous frame */
+            this->output->render->report_renderer_damage(frame_damage);
+        } else
+        {
+            /* Always report, since frame listeners may report their own
+             * damage as well */
+            this->output->render->report_renderer_damage(
+                this->output->get_relative_geometry());
+        }
+
+        collect_damage = false;
     };
 };
 }
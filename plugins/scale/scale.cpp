@@ -53,6 +53,8 @@ struct view_scale_data
     wf_scale *transformer = nullptr; /* avoid UB from uninitialized member */
     wf::animation::simple_animation_t fade_animation;
     wf_scale_animation_attribs animation;
+    /* Connected to the view's typed geometry-changed signal */
+    wf::typed_connection_t<wf::view_geometry_changed_signal> on_geometry_changed;
 };
 
 class wayfire_scale : public wf::plugin_interface_t
@@ -178,11 +180,17 @@ class wayfire_scale : public wf::plugin_interface_t
         }
 
         wf_scale *tr = new wf_scale(view);
-        scale_data[view].transformer = tr;
+        auto& view_data = scale_data[view];
+        view_data.transformer = tr;
         view->add_transformer(std::unique_ptr<wf_scale>(tr), transformer_name);
         /* Transformers are added only once when scale is activated so
          * this is a good place to connect the geometry-changed handler */
-        view->connect_signal("geometry-changed", &view_geometry_changed);
+        view_data.on_geometry_changed.set_callback(
+            [this] (wf::view_geometry_changed_signal*)
+        {
+            view_geometry_changed();
+        });
+        view->connect(&view_data.on_geometry_changed);
 
         return true;
     }
@@ -1048,19 +1056,18 @@ class wayfire_scale : public wf::plugin_interface_t
     };
 
     /* View geometry changed. Also called when workspace changes */
-    wf::signal_connection_t view_geometry_changed{[this] (wf::signal_data_t *data)
+    void view_geometry_changed()
+    {
+        auto views = get_views();
+        if (!views.size())
         {
-            auto views = get_views();
-            if (!views.size())
-            {
-                deactivate();
-
-                return;
-            }
+            deactivate();
 
-            layout_slots(std::move(views));
+            return;
         }
-    };
+
+        layout_slots(std::move(views));
+    }
 
     /* View minimized */
     wf::signal_connection_t view_minimized = [this] (wf::signal_data_t *data)
@@ -1237,7 +1244,6 @@ class wayfire_scale : public wf::plugin_interface_t
         view_attached.disconnect();
         view_minimized.disconnect();
         workspace_changed.disconnect();
-        view_geometry_changed.disconnect();
 
         if (!input_release_impending)
         {
@@ -1247,6 +1253,7 @@ class wayfire_scale : public wf::plugin_interface_t
 
         for (auto& e : scale_data)
         {
+            e.second.on_geometry_changed.disconnect();
             fade_in(e.first);
             setup_view_transform(e.second, 1, 1, 0, 0, 1);
         }
@@ -1272,7 +1279,6 @@ class wayfire_scale : public wf::plugin_interface_t
         view_detached.disconnect();
         view_minimized.disconnect();
         workspace_changed.disconnect();
-        view_geometry_changed.disconnect();
         output->deactivate_plugin(grab_interface);
     }
 
@@ -77,7 +77,8 @@ class wayfire_invert_screen : public wf::plugin_interface_t
                 output->render->rem_post(&hook);
             } else
             {
-                output->render->add_post(&hook);
+                /* Each pixel depends only on the same pixel in the source */
+                output->render->add_post(&hook, 0);
             }
 
             active = !active;
@@ -121,7 +122,12 @@ class wayfire_invert_screen : public wf::plugin_interface_t
         program.uniform1i("preserve_hue", preserve_hue);
 
         GL_CALL(glDisable(GL_BLEND));
-        GL_CALL(glDrawArrays(GL_TRIANGLE_FAN, 0, 4));
+        for (const auto& rect : output->render->get_post_damage())
+        {
+            destination.scissor(wlr_box_from_pixman_box(rect));
+            GL_CALL(glDrawArrays(GL_TRIANGLE_FAN, 0, 4));
+        }
+
         GL_CALL(glEnable(GL_BLEND));
         GL_CALL(glBindTexture(GL_TEXTURE_2D, 0));
 
@@ -138,9 +138,30 @@ class WayfireSwitcher : public wf::plugin_interface_t
         return handle_switch_request(1);
     };
 
+    /* The region which changes in the current frame */
+    wf::region_t frame_damage;
+    bool was_animating = false;
+
     wf::effect_hook_t damage = [=] ()
     {
-        output->render->damage_whole();
+        /* The frame after the animations end still differs from the last
+         * animated frame */
+        bool animating = duration.running() || background_dim_duration.running();
+        if (animating || was_animating)
+        {
+            frame_damage = output->get_relative_geometry();
+        } else
+        {
+            /* Only the contents of the switcher views can change now */
+            frame_damage.clear();
+            for (auto& sv : views)
+            {
+                frame_damage |= sv.view->get_bounding_box();
+            }
+        }
+
+        was_animating = animating;
+        output->render->damage(frame_damage);
     };
 
     wf::signal_callback_t view_removed = [=] (wf::signal_data_t *data)
@@ -577,6 +598,7 @@ class WayfireSwitcher : public wf::plugin_interface_t
 
     wf::render_hook_t switcher_renderer = [=] (const wf::framebuffer_t& fb)
     {
+        output->render->report_renderer_damage(frame_damage);
         OpenGL::render_begin(fb);
         OpenGL::clear({0, 0, 0, 1});
         OpenGL::render_end();
@@ -207,6 +207,7 @@ class workspace_switch_t
         for (auto v : wf::reverse(all_views))
         {
             v->render_transformed(fb, fb.geometry);
+            output->render->report_renderer_damage(v->get_bounding_box());
         }
     }
 
@@ -1,68 +1,154 @@
 #ifndef WF_SAFE_LIST_HPP
 #define WF_SAFE_LIST_HPP
 
-#include <list>
-#include <memory>
+#include <vector>
+#include <optional>
 #include <algorithm>
 #include <functional>
-
-#include <wayland-server.h>
+#include <stdexcept>
 
 #include "reverse.hpp"
 
-/* This is a trimmed-down wrapper of std::list<T>.
+/* This is a trimmed-down list of T, stored contiguously.
  *
  * It supports safe iteration over all elements in the collection, where any
  * element can be deleted from the list at any given time (i.e even in a
- * for-each-like loop) */
+ * for-each-like loop).
+ *
+ * While the list is being iterated, erased elements are left as tombstones
+ * and inserted elements are kept aside, so that the elements being iterated
+ * never move. Both are applied once the outermost iteration finishes.
+ *
+ * Note that this also holds for nested iterations: a for_each() started from
+ * within another iteration does not visit the elements inserted since the
+ * outermost iteration began. size() counts them, and back() sees the ones
+ * pushed to the end of the list. */
 namespace wf
 {
-/* The object type depends on the safe list type, and the safe list type
- * needs access to the event loop. However, the event loop is typically
- * available from core.hpp. Because we can't resolve this circular dependency,
- * we provide a link to the event loop specially for the safe list */
-namespace _safe_list_detail
-{
-/* In main.cpp, and initialized there */
-extern wl_event_loop *event_loop;
-void idle_cleanup_func(void *data);
-}
-
 template<class T>
 class safe_list_t
 {
-    std::list<std::unique_ptr<T>> list;
-    wl_event_source *idle_cleanup_source = NULL;
+  public:
+    enum insert_place_t
+    {
+        INSERT_BEFORE,
+        INSERT_AFTER,
+        INSERT_NONE,
+    };
+
+  private:
+    using check_t = std::function<insert_place_t(T&)>;
+
+    /* An element inserted during iteration. An empty check means the element
+     * goes to the end of the list */
+    struct pending_t
+    {
+        T value;
+        check_t check;
+    };
 
-    /* Remove all invalidated elements in the list */
-    std::function<void()> do_cleanup = [&] ()
+    /* for_each() is const, but it has to apply the changes made during the
+     * iteration once it finishes, hence all of the state is mutable */
+
+    /* The elements of the list, erased elements are empty */
+    mutable std::vector<std::optional<T>> list;
+    /* Elements inserted during iteration, in order of insertion */
+    mutable std::vector<pending_t> pending;
+    /* Number of non-empty elements in list */
+    mutable size_t alive = 0;
+    /* Number of empty elements in list */
+    mutable size_t erased = 0;
+    /* Number of iterations in progress */
+    mutable int iterating = 0;
+
+    /* Marks the list as being iterated during its lifetime */
+    struct iteration_t
     {
-        auto it = list.begin();
-        while (it != list.end())
+        const safe_list_t *self;
+        iteration_t(const safe_list_t *self) : self(self)
         {
-            if (*it)
+            ++self->iterating;
+        }
+
+        ~iteration_t()
+        {
+            if (--self->iterating == 0)
             {
-                ++it;
-            } else
+                self->apply_pending();
+            }
+        }
+    };
+
+    /* Insert value at the place indicated by check, or at the end of the
+     * list. Must not be called during iteration. */
+    void insert_now(T&& value, const check_t& check) const
+    {
+        size_t position = list.size();
+        if (check)
+        {
+            /* check() may modify the list, so prevent it from moving the
+             * elements while we look for the position */
+            ++iterating;
+            for (size_t i = 0; i < list.size(); i++)
             {
-                it = list.erase(it);
+                if (!list[i])
+                {
+                    continue;
+                }
+
+                auto place = check(*list[i]);
+                if (place != INSERT_NONE)
+                {
+                    position = (place == INSERT_AFTER) ? i + 1 : i;
+                    break;
+                }
             }
+
+            --iterating;
         }
 
-        idle_cleanup_source = NULL;
-    };
+        list.emplace(list.begin() + position, std::move(value));
+        ++alive;
+    }
 
-    /* Return whether the list has invalidated elements */
-    bool is_dirty() const
+    /* Remove the tombstones and insert the pending elements */
+    void apply_pending() const
     {
-        return idle_cleanup_source;
+        while (erased || !pending.empty())
+        {
+            if (erased)
+            {
+                list.erase(std::remove_if(list.begin(), list.end(),
+                    [] (const std::optional<T>& el) { return !el; }), list.end());
+                erased = 0;
+            }
+
+            auto to_insert = std::move(pending);
+            pending.clear();
+            for (auto& el : to_insert)
+            {
+                insert_now(std::move(el.value), el.check);
+            }
+        }
+    }
+
+    void insert(T&& value, check_t check)
+    {
+        if (iterating)
+        {
+            pending.push_back({std::move(value), std::move(check)});
+        } else
+        {
+            insert_now(std::move(value), check);
+            apply_pending();
+        }
     }
 
   public:
     safe_list_t()
     {}
 
-    /* Copy the not-erased elements from other, but do not copy the idle source */
+    /* Copy the not-erased elements from other */
     safe_list_t(const safe_list_t& other)
     {
         *this = other;
@@ -70,120 +156,72 @@ class safe_list_t
 
     safe_list_t& operator =(const safe_list_t& other)
     {
-        this->idle_cleanup_source = NULL;
+        clear();
         other.for_each([&] (auto& el)
         {
             this->push_back(el);
         });
+
+        return *this;
     }
 
     safe_list_t(safe_list_t&& other) = default;
     safe_list_t& operator =(safe_list_t&& other) = default;
 
-    ~safe_list_t()
-    {
-        if (idle_cleanup_source)
-        {
-            wl_event_source_remove(idle_cleanup_source);
-        }
-    }
-
+    /* Elements pushed back during iteration are considered, as they will be
+     * at the end of the list. Elements inserted with emplace_at() or
+     * insert_at() during iteration are not, since their position is known
+     * only once the iteration finishes. */
     T& back()
     {
-        /* No invalidated elements */
-        if (!is_dirty())
-        {
-            return *list.back();
-        }
-
-        auto it = list.rbegin();
-        while (it != list.rend() && (*it) == nullptr)
+        for (auto it = pending.rbegin(); it != pending.rend(); ++it)
         {
-            ++it;
+            if (!it->check)
+            {
+                return it->value;
+            }
         }
 
-        if (it == list.rend())
+        for (auto it = list.rbegin(); it != list.rend(); ++it)
         {
-            throw std::out_of_range("back() called on an empty list!");
+            if (*it)
+            {
+                return **it;
+            }
         }
 
-        return **it;
+        throw std::out_of_range("back() called on an empty list!");
     }
 
     size_t size() const
     {
-        if (!is_dirty())
-        {
-            return list.size();
-        }
-
-        /* Count non-null elements, because that's the real size */
-        size_t sz = 0;
-        for (auto& it : list)
-        {
-            sz += (it != nullptr);
-        }
+        return alive + pending.size();
+    }
 
-        return sz;
+    /* Whether an iteration over the list is in progress */
+    bool is_iterating() const
+    {
+        return iterating > 0;
     }
 
     /* Push back by copying */
     void push_back(T value)
     {
-        list.push_back(std::make_unique<T>(std::move(value)));
+        insert(std::move(value), nullptr);
     }
 
     /* Push back by moving */
     void emplace_back(T&& value)
     {
-        list.push_back(std::make_unique<T>(value));
+        insert(std::move(value), nullptr);
     }
 
-    enum insert_place_t
-    {
-        INSERT_BEFORE,
-        INSERT_AFTER,
-        INSERT_NONE,
-    };
-
     /* Insert the given value at a position in the list, determined by the
      * check function. The value is inserted at the first position that
      * check indicates, or at the end of the list otherwise */
     void emplace_at(T&& value, std::function<insert_place_t(T&)> check)
     {
-        auto it = list.begin();
-        while (it != list.end())
-        {
-            /* Skip empty elements */
-            if (*it == nullptr)
-            {
-                ++it;
-                continue;
-            }
-
-            auto place = check(**it);
-            switch (place)
-            {
-              case INSERT_AFTER:
-                /* We can safely increment it, because it points to an
-                 * element in the list */
-                ++it;
-
-              // fall through
-              case INSERT_BEFORE:
-                list.emplace(it, std::make_unique<T>(value));
-
-                return;
-
-              default:
-                break;
-            }
-
-            ++it;
-        }
-
-        /* If no place found, insert at the end */
-        emplace_back(std::move(value));
+        insert(std::move(value), std::move(check));
     }
 
     void insert_at(T value, std::function<insert_place_t(T&)> check)
@@ -192,28 +230,29 @@ class safe_list_t
     }
 
     /* Call func for each non-erased element of the list */
-    void for_each(std::function<void(T&)> func) const
+    template<class F>
+    void for_each(F&& func) const
     {
-        /* Go through all elements currently in the list */
-        auto it = list.begin();
-        for (int size = list.size(); size > 0; size--, it++)
+        iteration_t iteration{this};
+        for (size_t i = 0; i < list.size(); i++)
         {
-            if (*it)
+            if (list[i])
             {
-                func(**it);
+                func(*list[i]);
             }
         }
     }
 
     /* Call func for each non-erased element of the list in reversed order */
-    void for_each_reverse(std::function<void(T&)> func) const
+    template<class F>
+    void for_each_reverse(F&& func) const
     {
-        auto it = list.rbegin();
-        for (int size = list.size(); size > 0; size--, it++)
+        iteration_t iteration{this};
+        for (size_t i = list.size(); i > 0; i--)
         {
-            if (*it)
+            if (list[i - 1])
             {
-                func(**it);
+                func(*list[i - 1]);
             }
         }
     }
@@ -227,32 +266,40 @@ class safe_list_t
     /* Remove all elements from the list */
     void clear()
     {
-        remove_if([] (const T& el) { return true; });
+        remove_if([] (const T&) { return true; });
     }
 
     /* Remove all elements satisfying a given condition.
-     * This function resets their pointers and scheduling a cleanup operation */
-    void remove_if(std::function<bool(const T&)> predicate)
+     * Erased elements are destroyed immediately, but the list is compacted
+     * only when it is not being iterated. */
+    template<class F>
+    void remove_if(F&& predicate)
     {
-        bool actually_removed = false;
+        iteration_t iteration{this};
         for (auto& it : list)
         {
             if (it && predicate(*it))
             {
-                actually_removed = true;
                 /* First reset the element in the list, and then free resources */
-                auto copy = std::move(it);
-                it = nullptr;
+                std::optional<T> copy;
+                copy.swap(it);
+                --alive;
+                ++erased;
                 /* Now copy goes out of scope */
             }
         }
 
-        /* Schedule a clean-up, but be careful to not schedule it twice */
-        if (!idle_cleanup_source && actually_removed)
+        for (size_t i = 0; i < pending.size();)
         {
-            idle_cleanup_source = wl_event_loop_add_idle(
-                _safe_list_detail::event_loop,
-                _safe_list_detail::idle_cleanup_func, &do_cleanup);
+            if (predicate(pending[i].value))
+            {
+                std::optional<T> copy;
+                copy.emplace(std::move(pending[i].value));
+                pending.erase(pending.begin() + i);
+            } else
+            {
+                ++i;
+            }
         }
     }
 };
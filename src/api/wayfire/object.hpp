@@ -2,6 +2,8 @@
 #define OBJECT_HPP
 
 #include <typeinfo>
+#include <typeindex>
+#include <functional>
 #include <memory>
 #include <string>
 
@@ -22,6 +24,43 @@ struct signal_data_t
 using signal_callback_t = std::function<void (signal_data_t*)>;
 class signal_provider_t;
 
+/**
+ * An interned signal name.
+ *
+ * Signal providers look up their connections by the index of the signal ID,
+ * which is much cheaper than hashing the name on each emission. Signals which
+ * are emitted often should therefore use a signal ID created once, for
+ * example as a static variable, instead of the name.
+ */
+class signal_id_t
+{
+  public:
+    /** Get the ID of the signal with the given name. */
+    explicit signal_id_t(const std::string& name);
+
+    /** @return A unique index for the signal name. */
+    uint32_t get_index() const
+    {
+        return index;
+    }
+
+    /** @return The name of the signal. */
+    const std::string& get_name() const;
+
+    bool operator ==(const signal_id_t& other) const
+    {
+        return index == other.index;
+    }
+
+    bool operator !=(const signal_id_t& other) const
+    {
+        return index != other.index;
+    }
+
+  private:
+    uint32_t index;
+};
+
 /**
  * Provides an interface to connect to signal providers.
  *
@@ -63,11 +102,184 @@ class signal_connection_t : public noncopyable_t
     signal_connection_t& operator =(signal_connection_t&& other) = delete;
 };
 
+class typed_signal_base_t;
+
+/**
+ * The base class of typed signal connections, see typed_connection_t.
+ *
+ * Connections are nodes of an intrusive list in the signal they are connected
+ * to, so connecting and disconnecting do not allocate memory, and
+ * disconnecting takes constant time. A connection can be connected to a
+ * single signal at a time.
+ */
+class typed_connection_base_t : public noncopyable_t
+{
+  public:
+    /** Automatically disconnects from the signal */
+    virtual ~typed_connection_base_t();
+
+    /** Disconnect from the signal, if connected. */
+    void disconnect();
+
+    /** @return Whether the connection is connected to a signal. */
+    bool is_connected() const
+    {
+        return signal != nullptr;
+    }
+
+  protected:
+    typed_connection_base_t() = default;
+    virtual void emit_erased(void *data) = 0;
+
+  private:
+    friend class typed_signal_base_t;
+    typed_signal_base_t *signal = nullptr;
+    typed_connection_base_t *prev = nullptr;
+    typed_connection_base_t *next = nullptr;
+};
+
+/**
+ * A connection to signals with data of type T.
+ */
+template<class T>
+class typed_connection_t : public typed_connection_base_t
+{
+  public:
+    using callback_t = std::function<void (T*)>;
+
+    /** Initialize an empty connection */
+    typed_connection_t() = default;
+
+    /** Initialize a connection with the given callback */
+    template<class F, class U =
+        std::enable_if_t<std::is_constructible_v<callback_t, F>, void>>
+    typed_connection_t(F callback) : callback(std::move(callback))
+    {}
+
+    /** Set the callback or override the existing callback. */
+    void set_callback(callback_t callback)
+    {
+        this->callback = std::move(callback);
+    }
+
+    /** Call the stored callback with the given data. */
+    void emit(T *data)
+    {
+        if (callback)
+        {
+            callback(data);
+        }
+    }
+
+  private:
+    callback_t callback;
+
+    void emit_erased(void *data) override
+    {
+        emit(static_cast<T*>(data));
+    }
+};
+
+/**
+ * The type-erased part of typed_signal_t.
+ *
+ * Connections may be connected and disconnected during an emission.
+ * Connections added during an emission are not called by it.
+ */
+class typed_signal_base_t : public noncopyable_t
+{
+  public:
+    typed_signal_base_t() = default;
+    /** Disconnects all connections */
+    virtual ~typed_signal_base_t();
+
+    /** @return Whether there are no connections. */
+    bool empty() const
+    {
+        return head == nullptr;
+    }
+
+    /**
+     * Connect the given connection, disconnecting it from the signal it was
+     * connected to before. The data type of the connection must match the
+     * data type of the signal.
+     */
+    void connect(typed_connection_base_t *connection);
+
+    /** Call all connections with the given data. */
+    void emit(void *data);
+
+  private:
+    friend class typed_connection_base_t;
+    void remove(typed_connection_base_t *connection);
+
+    typed_connection_base_t *head = nullptr;
+    typed_connection_base_t *tail = nullptr;
+
+    /* The state of the emissions in progress, innermost first */
+    struct emission_t
+    {
+        typed_connection_base_t *next;
+        typed_connection_base_t *last;
+        emission_t *outer;
+    };
+
+    emission_t *emissions = nullptr;
+};
+
+/**
+ * A signal with data of type T, which can be used by plugins for their own
+ * signals. Signal providers also support typed signals, see
+ * signal_provider_t::connect().
+ */
+template<class T>
+class typed_signal_t : public typed_signal_base_t
+{
+  public:
+    void connect(typed_connection_t<T> *connection)
+    {
+        typed_signal_base_t::connect(connection);
+    }
+
+    void emit(T *data)
+    {
+        typed_signal_base_t::emit(data);
+    }
+};
+
 class signal_provider_t
 {
   public:
+    /**
+     * Connect to the signal with data type T.
+     *
+     * Typed signals are identified by the type of their data, so each signal
+     * emitted this way needs its own data type.
+     */
+    template<class T>
+    void connect(typed_connection_t<T> *connection)
+    {
+        _get_typed_signal(typeid(T)).connect(connection);
+    }
+
+    /**
+     * Emit the signal with data type T. Does nothing if no connections are
+     * connected to it. T has to be the exact type of the signal, not a base
+     * class of it.
+     */
+    template<class T>
+    void emit(T *data)
+    {
+        if (auto signal = _find_typed_signal(typeid(T)))
+        {
+            signal->emit(data);
+        }
+    }
+
     /** Register a connection to be called when the given signal is emitted. */
     void connect_signal(std::string name, signal_connection_t *callback);
+    /** Same as connect_signal(name, callback), with an interned name. */
+    void connect_signal(signal_id_t signal, signal_connection_t *callback);
     /** Unregister a connection. */
     void disconnect_signal(signal_connection_t *callback);
 
@@ -83,7 +295,13 @@ class signal_provider_t
     void disconnect_signal(std::string name, signal_callback_t *callback);
 
     /** Emit the given signal. No type checking for data is required */
-    void emit_signal(std::string name, signal_data_t *data);
+    void emit_signal(const std::string& name, signal_data_t *data);
+
+    /**
+     * Same as emit_signal(name, data), with an interned name.
+     * Does nothing if no callbacks are connected to the signal.
+     */
+    void emit_signal(signal_id_t signal, signal_data_t *data);
 
     virtual ~signal_provider_t();
 
@@ -91,6 +309,11 @@ class signal_provider_t
     signal_provider_t();
 
   private:
+    /** Get the typed signal with the given type, creating it if necessary */
+    typed_signal_base_t& _get_typed_signal(std::type_index type);
+    /** Get the typed signal with the given type, or nullptr */
+    typed_signal_base_t *_find_typed_signal(std::type_index type);
+
     class sprovider_impl;
     std::unique_ptr<sprovider_impl> sprovider_priv;
 };
@@ -126,43 +349,52 @@ class object_base_t : public signal_provider_t
      * If your type doesn't have one, use store_data + get_data
      */
     template<class T>
-    nonstd::observer_ptr<T> get_data_safe(
-        std::string name = typeid(T).name())
+    nonstd::observer_ptr<T> get_data_safe(std::string name)
     {
-        auto data = get_data<T>(name);
-        if (data)
-        {
-            return data;
-        } else
-        {
-            store_data<T>(std::make_unique<T>(), name);
+        return _get_data_safe<T>(_data_slot(name));
+    }
 
-            return get_data<T>(name);
-        }
+    /** Same as get_data_safe(name), with the name of the type T */
+    template<class T>
+    nonstd::observer_ptr<T> get_data_safe()
+    {
+        return _get_data_safe<T>(_type_slot<T>());
     }
 
     /* Retrieve custom data stored with the given name. If no such
      * data exists, NULL is returned */
     template<class T>
-    nonstd::observer_ptr<T> get_data(
-        std::string name = typeid(T).name())
+    nonstd::observer_ptr<T> get_data(std::string name)
+    {
+        return _get_data<T>(_data_slot(name));
+    }
+
+    /** Same as get_data(name), with the name of the type T */
+    template<class T>
+    nonstd::observer_ptr<T> get_data()
     {
-        return nonstd::make_observer(dynamic_cast<T*>(_fetch_data(name)));
+        return _get_data<T>(_type_slot<T>());
     }
 
     /* Assigns the given data to the given name */
     template<class T>
-    void store_data(std::unique_ptr<T> stored_data,
-        std::string name = typeid(T).name())
+    void store_data(std::unique_ptr<T> stored_data, std::string name)
+    {
+        _store_data(std::move(stored_data), _data_slot(name));
+    }
+
+    /** Same as store_data(data, name), with the name of the type T */
+    template<class T>
+    void store_data(std::unique_ptr<T> stored_data)
     {
-        _store_data(std::move(stored_data), name);
+        _store_data(std::move(stored_data), _type_slot<T>());
     }
 
     /* Returns true if there is saved data under the given name */
     template<class T>
     bool has_data()
     {
-        return has_data(typeid(T).name());
+        return _fetch_data(_type_slot<T>()) != nullptr;
     }
 
     /** @return true if there is saved data with the given name */
@@ -175,22 +407,21 @@ class object_base_t : public signal_provider_t
     template<class T>
     void erase_data()
     {
-        erase_data(typeid(T).name());
+        _erase_data(_type_slot<T>());
     }
 
     /* Erase the saved data from the store and return the pointer */
     template<class T>
-    std::unique_ptr<T> release_data(
-        std::string name = typeid(T).name())
+    std::unique_ptr<T> release_data(std::string name)
     {
-        if (!has_data(name))
-        {
-            return {nullptr};
-        }
-
-        auto stored = _fetch_erase(name);
+        return _release_data<T>(_data_slot(name));
+    }
 
-        return std::unique_ptr<T>(dynamic_cast<T*>(stored));
+    /** Same as release_data(name), with the name of the type T */
+    template<class T>
+    std::unique_ptr<T> release_data()
+    {
+        return _release_data<T>(_type_slot<T>());
     }
 
     virtual ~object_base_t();
@@ -202,14 +433,67 @@ class object_base_t : public signal_provider_t
     void _clear_data();
 
   private:
-    /** Just get the data under the given name, or nullptr, if it does not exist */
-    custom_data_t *_fetch_data(std::string name);
-    /** Get the data under the given name, and release the pointer, deleting
-     * the entry in the map */
-    custom_data_t *_fetch_erase(std::string name);
-
-    /** Store the given data under the given name */
-    void _store_data(std::unique_ptr<custom_data_t> data, std::string name);
+    /**
+     * Custom data is stored in slots. Each name gets a slot the first time it
+     * is used, and the slot is the same for all objects, so lookups by slot
+     * are an array access.
+     *
+     * @return The slot of the data with the given name.
+     */
+    static uint32_t _data_slot(const std::string& name);
+
+    /** @return The slot of the data named after the type T. */
+    template<class T>
+    static uint32_t _type_slot()
+    {
+        static const uint32_t slot = _data_slot(typeid(T).name());
+        return slot;
+    }
+
+    template<class T>
+    nonstd::observer_ptr<T> _get_data(uint32_t slot)
+    {
+        return nonstd::make_observer(dynamic_cast<T*>(_fetch_data(slot)));
+    }
+
+    template<class T>
+    nonstd::observer_ptr<T> _get_data_safe(uint32_t slot)
+    {
+        auto data = _get_data<T>(slot);
+        if (data)
+        {
+            return data;
+        } else
+        {
+            _store_data(std::make_unique<T>(), slot);
+
+            return _get_data<T>(slot);
+        }
+    }
+
+    template<class T>
+    std::unique_ptr<T> _release_data(uint32_t slot)
+    {
+        if (!_fetch_data(slot))
+        {
+            return {nullptr};
+        }
+
+        auto stored = _fetch_erase(slot);
+
+        return std::unique_ptr<T>(dynamic_cast<T*>(stored));
+    }
+
+    /** Just get the data in the given slot, or nullptr, if it does not exist */
+    custom_data_t *_fetch_data(uint32_t slot);
+    /** Get the data in the given slot, and release the pointer, emptying the
+     * slot */
+    custom_data_t *_fetch_erase(uint32_t slot);
+
+    /** Store the given data in the given slot */
+    void _store_data(std::unique_ptr<custom_data_t> data, uint32_t slot);
+    /** Destroy the data in the given slot, if any */
+    void _erase_data(uint32_t slot);
 
     class obase_impl;
     std::unique_ptr<obase_impl> obase_priv;
@@ -164,6 +164,12 @@ namespace OpenGL
  * because
  * that's the only time we're guaranteed we have a valid GLES context
  *
+ * render_begin/render_end blocks can be nested. A nested block only binds its
+ * framebuffer if it differs from the enclosing one, so wrapping a series of
+ * draws in an outer block (a render pass) avoids restarting the renderer for
+ * each of them. When a nested block ends, the enclosing framebuffer and
+ * viewport are restored.
+ *
  * The other functions below assume they are called between render_begin()
  * and render_end() */
 void render_begin(); // use if you just want to bind GL context but won't draw
@@ -242,6 +248,29 @@ void render_texture(wf::texture_t texture,
     glm::vec4 color = glm::vec4(1.f),
     uint32_t bits   = 0);
 
+/**
+ * Render the parts of a textured quad which are inside the given region.
+ * All parts are drawn with a single draw call, instead of scissoring and
+ * drawing the whole quad once for each rectangle of the region.
+ *
+ * @param texture   The texture to render.
+ * @param fb        The framebuffer to render onto.
+ *                  It should have been already bound.
+ * @param geometry  The geometry of the quad to render, in the same coordinate
+ *                    system as the framebuffer geometry.
+ * @param damage    The region to render, in the same coordinate system as
+ *                    the geometry.
+ * @param color     A color multiplier for each channel of the texture.
+ * @param bits      A bitwise OR of texture_rendering_flags_t. In this variant,
+ *                    TEX_GEOMETRY flag is ignored.
+ */
+void render_texture(wf::texture_t texture,
+    const wf::framebuffer_t& framebuffer,
+    const wf::geometry_t& geometry,
+    const wf::region_t& damage,
+    glm::vec4 color = glm::vec4(1.f),
+    uint32_t bits   = 0);
+
 /* Compiles the given shader source */
 GLuint compile_shader(std::string source, GLuint type);
 
@@ -262,6 +291,16 @@ GLuint compile_program(std::string vertex_source, std::string frag_source);
  */
 void render_rectangle(wf::geometry_t box, wf::color_t color, glm::mat4 matrix);
 
+/**
+ * The location of a uniform or an attribute in each of the programs of a
+ * program_t. See program_t::get_uniform() and program_t::get_attrib().
+ */
+struct program_location_t
+{
+    /* -1 if the program for the texture type does not have the variable */
+    int location[wf::TEXTURE_TYPE_ALL] = {-1, -1, -1};
+};
+
 /**
  * An OpenGL program for rendering texture_t.
  * It contains multiple programs for the different texture types.
@@ -313,6 +352,22 @@ class program_t : public noncopyable_t
     /** @return The program ID for the given texture type, or 0 on failure */
     int get_program_id(wf::texture_type_t type);
 
+    /**
+     * Look up the location of a uniform in all programs.
+     *
+     * The uniform setters which take a program_location_t do not need any
+     * string lookups, so plugins can resolve the locations they need once
+     * after compiling the program and use them on every draw.
+     * The locations are invalidated when the program is recompiled or freed.
+     */
+    program_location_t get_uniform(const std::string& name);
+
+    /**
+     * Look up the location of an attribute in all programs.
+     * Same as get_uniform(), but for attributes.
+     */
+    program_location_t get_attrib(const std::string& name);
+
     /** Set the given uniform for the currently used program. */
     void uniform1i(const std::string& name, int value);
     /** Set the given uniform for the currently used program. */
@@ -326,6 +381,20 @@ class program_t : public noncopyable_t
     /** Set the given uniform for the currently used program. */
     void uniformMatrix4f(const std::string& name, const glm::mat4& value);
 
+    /** Set the given uniform for the currently used program. */
+    void uniform1i(const program_location_t& uniform, int value);
+    /** Set the given uniform for the currently used program. */
+    void uniform1f(const program_location_t& uniform, float value);
+    /** Set the given uniform for the currently used program. */
+    void uniform2f(const program_location_t& uniform, float x, float y);
+    /** Set the given uniform for the currently used program. */
+    void uniform3f(const program_location_t& uniform, float x, float y, float z);
+    /** Set the given uniform for the currently used program. */
+    void uniform4f(const program_location_t& uniform, const glm::vec4& value);
+    /** Set the given uniform for the currently used program. */
+    void uniformMatrix4f(const program_location_t& uniform,
+        const glm::mat4& value);
+
     /*
      * Set the attribute pointer and active the attribute.
      *
@@ -344,6 +413,17 @@ class program_t : public noncopyable_t
      */
     void attrib_divisor(const std::string& attrib, int divisor);
 
+    /**
+     * Same as attrib_pointer(), but with an already resolved location.
+     * If a vertex buffer is bound to GL_ARRAY_BUFFER, ptr is an offset into
+     * it, as with glVertexAttribPointer().
+     */
+    void attrib_pointer(const program_location_t& attrib,
+        int size, int stride, const void *ptr, GLenum type = GL_FLOAT);
+
+    /** Same as attrib_divisor(), but with an already resolved location. */
+    void attrib_divisor(const program_location_t& attrib, int divisor);
+
     /**
      * Set the active texture, and modify the builtin Y-inversion uniforms.
      * Will not work with custom programs.
@@ -75,6 +75,20 @@ class render_manager : public wf::signal_provider_t
      */
     void set_renderer(render_hook_t rh = nullptr);
 
+    /**
+     * Report which part of the output the render hook has changed in the
+     * current frame. Should be called only from the render hook, possibly
+     * multiple times, in which case the regions are combined.
+     *
+     * The render hook still has to repaint the whole target framebuffer, but
+     * only the reported region (and the output damage) is swapped and
+     * presented. If the render hook does not report anything in a frame, the
+     * whole output is assumed to have changed.
+     *
+     * @param damage The changed region, in output-local coordinates.
+     */
+    void report_renderer_damage(const wf::region_t& damage);
+
     /**
      * Rendering an output is done on demand, that is, when the output is
      * damaged. Some plugins however need to redraw the output as often as
@@ -97,6 +111,9 @@ class render_manager : public wf::signal_provider_t
     /**
      * Inhibit rendering to the output. An inhibited output will show a
      * fully black image. Used mainly for compositor fade in/out on startup.
+     *
+     * While the output is inhibited, it is not repainted, effect hooks are not
+     * run and the views on it do not receive frame events.
      */
     void add_inhibit(bool add);
 
@@ -119,6 +136,32 @@ class render_manager : public wf::signal_provider_t
      */
     void add_post(post_hook_t *hook);
 
+    /**
+     * Add a new damage-local post hook.
+     *
+     * A damage-local hook only has to update the region returned by
+     * get_post_damage() in its destination buffer, instead of the whole
+     * output. Outside of it, the destination keeps the contents from the
+     * previous frame. The damage is expanded by the sampling radii of all
+     * hooks, so a hook may read its source up to sampling_radius pixels away
+     * from the pixels it writes.
+     *
+     * If any hook on the output is not damage-local, all hooks have to
+     * process the whole output.
+     *
+     * @param hook The hook callback
+     * @param sampling_radius How far from a destination pixel the hook reads
+     *   the source, in output buffer pixels.
+     */
+    void add_post(post_hook_t *hook, int sampling_radius);
+
+    /**
+     * @return The region which post hooks have to update in the current frame,
+     *   in the coordinate system of framebuffer_base_t::scissor() for the post
+     *   buffers. This function should only be called from post hooks.
+     */
+    const wf::region_t& get_post_damage();
+
     /**
      * Remove a post hook. No-op if hook isn't active.
      *
@@ -185,20 +228,34 @@ class render_manager : public wf::signal_provider_t
      * Initialize a workspace stream. If you need to change the stream's
      * attributes, you should stop the stream, and start it again
      *
+     * The stream is started with the scale in its scale_x and scale_y fields,
+     * so that the first update does not have to render it at full resolution.
+     *
      * @param stream The stream to be initialized
      */
     void workspace_stream_start(workspace_stream_t& stream);
 
     /**
      * Update the workspace stream with the latest contents on the workspace.
-     * This function should be called inside the rendering cycle, i.e in a
-     * render or an overlay hook.
+     * This function should usually be called inside the rendering cycle, i.e
+     * in a render or an overlay hook. Streams may also be updated outside of
+     * it, for example to keep them up to date in the background. The stream
+     * repaints the damage of all frames since it was last updated, or the
+     * whole workspace if that was too many frames ago, so it does not need to
+     * be updated on every frame while it is running.
+     *
+     * The stream buffer is rendered at a reduced resolution if the stream is
+     * going to be displayed scaled down, for example as a tile in an overview.
+     * Streams are scaled uniformly by the larger factor, rounded up to a
+     * multiple of 1/8, and never above 1. Changing the scale repaints the
+     * whole stream.
      *
      * @param stream The workspace stream to update
-     * @param scale_x Unused for now
-     * @param scale_y Unused for now
+     * @param scale_x The horizontal scale at which the stream will be shown
+     * @param scale_y The vertical scale at which the stream will be shown
+     * @return Whether anything was repainted
      */
-    void workspace_stream_update(workspace_stream_t& stream,
+    bool workspace_stream_update(workspace_stream_t& stream,
         float scale_x = 1, float scale_y = 1);
     /**
      * Stop the workspace stream. You can change the stream's workspace
@@ -208,6 +265,13 @@ class render_manager : public wf::signal_provider_t
      */
     void workspace_stream_stop(workspace_stream_t& stream);
 
+    /**
+     * @return The memory used by the buffers of the workspace streams on this
+     *   output, in bytes, including the buffers of stopped streams which have
+     *   not been released yet. See the workspace-stream-enumerate signal.
+     */
+    size_t get_workspace_stream_memory();
+
   private:
     class impl;
     std::unique_ptr<impl> pimpl;
@@ -115,6 +115,15 @@ struct surface_map_state_changed_signal : public wf::signal_data_t
  * argument: unused
  */
 
+/**
+ * name: dump-stats
+ * on: core
+ * when: When debug statistics (frame timings, etc.) should be written to the
+ *   log. Wayfire emits this when it receives SIGUSR1, but plugins may emit it
+ *   as well.
+ * argument: unused
+ */
+
 /**
  * name: keyboard-focus-changed
  * on: core
@@ -342,8 +351,11 @@ using view_unmapped_signal = _view_signal;
  * when: Immediately after the view's output changes. Note that child views may
  *   still be on the old output.
  * argument: The old output of the view.
+ * typed: Also emitted as a typed signal on the view, see
+ *   signal_provider_t::connect().
  */
-using view_set_output_signal = _output_signal;
+struct view_set_output_signal : public _output_signal
+{};
 
 /* ----------------------------------------------------------------------------/
  * View state signals
@@ -518,6 +530,8 @@ struct view_show_window_menu_signal : public _view_signal
  * name: geometry-changed
  * on: view, output(view-), core(view-)
  * when: Whenever the view's wm geometry changes.
+ * typed: Also emitted as a typed signal on the view, see
+ *   signal_provider_t::connect().
  */
 struct view_geometry_changed_signal : public _view_signal
 {
@@ -2,6 +2,7 @@
 #define WORKSPACE_MANAGER_HPP
 
 #include <functional>
+#include <memory>
 #include <vector>
 #include <wayfire/view.hpp>
 
@@ -98,6 +99,124 @@ enum sublayer_mode_t
     SUBLAYER_FLOATING     = 2,
 };
 
+/**
+ * A rectangular range of workspaces in the workspace grid. It can be iterated
+ * over without allocating memory.
+ */
+struct workspace_range_t
+{
+    /** The top-left and the bottom-right workspace of the range, inclusive */
+    wf::point_t first = {0, 0};
+    wf::point_t last  = {-1, -1};
+
+    bool empty() const
+    {
+        return first.x > last.x || first.y > last.y;
+    }
+
+    bool contains(wf::point_t ws) const
+    {
+        return first.x <= ws.x && ws.x <= last.x &&
+               first.y <= ws.y && ws.y <= last.y;
+    }
+
+    /** Iterates over the workspaces column by column */
+    class iterator
+    {
+      public:
+        iterator(wf::point_t ws, int first_y, int last_y) :
+            ws(ws), first_y(first_y), last_y(last_y)
+        {}
+
+        wf::point_t operator *() const
+        {
+            return ws;
+        }
+
+        iterator& operator ++()
+        {
+            if (++ws.y > last_y)
+            {
+                ws.y = first_y;
+                ++ws.x;
+            }
+
+            return *this;
+        }
+
+        bool operator !=(const iterator& other) const
+        {
+            return ws != other.ws;
+        }
+
+      private:
+        wf::point_t ws;
+        int first_y, last_y;
+    };
+
+    iterator begin() const
+    {
+        return empty() ? end() : iterator{first, first.y, last.y};
+    }
+
+    iterator end() const
+    {
+        return iterator{{last.x + 1, first.y}, first.y, last.y};
+    }
+};
+
+/**
+ * A read-only snapshot of the stacking order of the views in some layers, as
+ * returned by workspace_manager::get_stacking_order().
+ *
+ * Snapshots share their storage with the workspace manager's cache, so copying
+ * them is cheap. A snapshot stays valid and unchanged even if the stacking
+ * order changes while it is being iterated.
+ */
+class stacking_order_t
+{
+  public:
+    using container_t = std::vector<wayfire_view>;
+
+    stacking_order_t(std::shared_ptr<const container_t> views) :
+        views(std::move(views))
+    {}
+
+    container_t::const_iterator begin() const
+    {
+        return views->begin();
+    }
+
+    container_t::const_iterator end() const
+    {
+        return views->end();
+    }
+
+    size_t size() const
+    {
+        return views->size();
+    }
+
+    bool empty() const
+    {
+        return views->empty();
+    }
+
+    const wayfire_view& operator [](size_t idx) const
+    {
+        return (*views)[idx];
+    }
+
+    /** @return The views in the snapshot, topmost first. */
+    const container_t& get() const
+    {
+        return *views;
+    }
+
+  private:
+    std::shared_ptr<const container_t> views;
+};
+
 /**
  * Workspace manager is responsible for managing the layers, the workspaces and
  * the views in them. There is one workspace manager per output.
@@ -122,6 +241,22 @@ class workspace_manager
     std::vector<wf::point_t> get_view_workspaces(wayfire_view view,
         double threshold);
 
+    /**
+     * Get the range of workspaces overlapped by the given box, clamped to the
+     * workspace grid. This is computed directly from the box, without checking
+     * each workspace.
+     *
+     * @param box The box in output-local coordinates.
+     */
+    workspace_range_t get_workspace_range(wf::geometry_t box);
+
+    /**
+     * Get the range of workspaces the view may be visible on, i.e the
+     * workspaces overlapped by its bounding box and wm geometry, or all
+     * workspaces for sticky views. Use view_visible_on() for the exact check.
+     */
+    workspace_range_t get_view_workspace_range(wayfire_view view);
+
     /**
      * Check if the given view is visible on the given workspace
      */
@@ -137,6 +272,42 @@ class workspace_manager
     std::vector<wayfire_view> get_views_on_workspace(wf::point_t ws,
         uint32_t layer_mask);
 
+    /**
+     * Get a list of the views whose bounding box contains the given point, for
+     * example to find the view under the cursor. The views are ordered like in
+     * get_views_in_layer(), and each view is preceded by its child views, like
+     * in view_interface_t::enumerate_views(). Child views of unmapped views are
+     * not included.
+     *
+     * The bounding boxes are kept in a spatial index, so this does not need to
+     * iterate over all views.
+     *
+     * @param point The point in output-local coordinates.
+     * @param layer_mask - The layers whose views should be included
+     */
+    std::vector<wayfire_view> get_views_at(wf::pointf_t point,
+        uint32_t layer_mask);
+
+    /**
+     * Get the part of a box where get_views_at() does not return any view
+     * before the given one, i.e where no other view in the given layers is
+     * tried for input before it.
+     *
+     * @param box The box in output-local coordinates.
+     * @return The region in output-local coordinates, empty if the view is not
+     *   in the given layers.
+     */
+    wf::region_t get_exposed_region(wayfire_view view, wf::geometry_t box,
+        uint32_t layer_mask);
+
+    /**
+     * Get a serial which changes whenever the results of get_views_at() and
+     * get_exposed_region() may change, i.e when views are mapped, unmapped or
+     * restacked, or their bounding box changes. Serials of different outputs
+     * are never equal.
+     */
+    uint64_t get_views_serial();
+
     /**
      * Get a list of all views visible on the given workspace and in the given
      * sublayer.
@@ -220,6 +391,15 @@ class workspace_manager
      */
     std::vector<wayfire_view> get_views_in_layer(uint32_t layers_mask);
 
+    /**
+     * Same as get_views_in_layer(), but without copying the list of views.
+     *
+     * The stacking order is cached per layer mask and rebuilt only after views
+     * are added, removed, restacked or promoted, so repeated queries between
+     * such changes are O(1).
+     */
+    stacking_order_t get_stacking_order(uint32_t layers_mask);
+
     /**
      * Get a list of reordered fullscreen views as explained in
      * get_views_in_layer().
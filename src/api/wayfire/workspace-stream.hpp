@@ -1,6 +1,7 @@
 #ifndef WF_WORKSPACE_STREAM_HPP
 #define WF_WORKSPACE_STREAM_HPP
 
+#include <vector>
 #include "wayfire/opengl.hpp"
 #include "wayfire/object.hpp"
 
@@ -14,9 +15,21 @@ struct workspace_stream_t
     wf::framebuffer_base_t buffer;
     bool running = false;
 
+    /* The scale at which the buffer was last rendered, relative to the
+     * output resolution. See render_manager::workspace_stream_update() */
     float scale_x = 1.0;
     float scale_y = 1.0;
 
+    /* The sequence number of the output frame in which the stream was last
+     * updated, 0 if never. Used by the render manager to repaint the damage
+     * from the frames in which the stream was running but not updated. */
+    uint64_t last_frame = 0;
+
+    /* When the stream was last updated or stopped, as returned by
+     * wf::get_current_time(). Buffers of stopped streams are released in
+     * least recently used order when over the stream memory budget. */
+    uint32_t last_used = 0;
+
     /* The background color of the stream, when there is no view above it.
      * All streams start with -1.0 alpha to indicate that the color is
      * invalid. In this case, we use the default color, which can
@@ -44,9 +57,39 @@ struct stream_signal_t : public wf::signal_data_t
     wf::point_t ws;
     /** The damage on the stream, in output-local coordinates */
     wf::region_t& raw_damage;
-    /** The framebuffer of the stream, fb has output-local geometry. */
+    /** The framebuffer of the stream, fb has output-local geometry.
+     * Its scale includes the scale of the stream. */
     const wf::framebuffer_t& fb;
 };
+
+/**
+ * name: workspace-stream-enumerate
+ * on: render-manager
+ * when: When the render manager needs to know which workspace streams are
+ *   kept on the output, to account for their memory and to release the
+ *   buffers of stopped streams when over core/stream_memory_budget.
+ *   Plugins which keep their own workspace streams should add them to the
+ *   list. The pointers are used only during the signal emission.
+ */
+struct stream_enumerate_signal_t : public wf::signal_data_t
+{
+    std::vector<workspace_stream_t*> streams;
+};
+
+/**
+ * name: workspace-stream-prewarm
+ * on: render-manager
+ * when: After the output was repainted in a frame event, if the predicted
+ *   render time of the output fits before the next frame event. Plugins may
+ *   update workspace streams in the background here, doing about as much work
+ *   as one repaint of the output. The signal is not emitted while the output
+ *   is inhibited.
+ */
+struct stream_prewarm_signal_t : public wf::signal_data_t
+{
+    /** Set to true if there is more work, so that another frame is requested */
+    bool pending = false;
+};
 }
 
 #endif /* end of include guard: WF_WORKSPACE_STREAM_HPP */
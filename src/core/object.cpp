@@ -1,8 +1,47 @@
 #include "wayfire/object.hpp"
 #include "wayfire/nonstd/safe-list.hpp"
+#include <typeindex>
 #include <unordered_map>
+#include <vector>
 #include <set>
 
+namespace
+{
+/* All signal names which have been interned so far */
+struct signal_names_t
+{
+    std::unordered_map<std::string, uint32_t> indices;
+    std::vector<std::string> names;
+};
+
+signal_names_t& get_signal_names()
+{
+    static signal_names_t signal_names;
+
+    return signal_names;
+}
+}
+
+wf::signal_id_t::signal_id_t(const std::string& name)
+{
+    auto& all = get_signal_names();
+    auto it   = all.indices.find(name);
+    if (it != all.indices.end())
+    {
+        index = it->second;
+    } else
+    {
+        index = all.names.size();
+        all.indices.emplace(name, index);
+        all.names.push_back(name);
+    }
+}
+
+const std::string& wf::signal_id_t::get_name() const
+{
+    return get_signal_names().names[index];
+}
+
 /* Implementation note: because of circular dependencies between
  * signal_connection_t and signal_provider_t, the chosen way to resolve
  * them is to have signal_provider_t directly modify signal_connection_t
@@ -57,14 +96,114 @@ void wf::signal_connection_t::disconnect()
     }
 }
 
+wf::typed_connection_base_t::~typed_connection_base_t()
+{
+    disconnect();
+}
+
+void wf::typed_connection_base_t::disconnect()
+{
+    if (signal)
+    {
+        signal->remove(this);
+    }
+}
+
+wf::typed_signal_base_t::~typed_signal_base_t()
+{
+    while (head)
+    {
+        remove(head);
+    }
+}
+
+void wf::typed_signal_base_t::connect(typed_connection_base_t *connection)
+{
+    connection->disconnect();
+    connection->signal = this;
+    connection->prev   = tail;
+    connection->next   = nullptr;
+    if (tail)
+    {
+        tail->next = connection;
+    } else
+    {
+        head = connection;
+    }
+
+    tail = connection;
+}
+
+void wf::typed_signal_base_t::remove(typed_connection_base_t *connection)
+{
+    /* Keep the emissions in progress pointing to connections in the list */
+    for (auto em = emissions; em; em = em->outer)
+    {
+        if (em->next == connection)
+        {
+            em->next = (connection == em->last) ? nullptr : connection->next;
+        }
+
+        if (em->last == connection)
+        {
+            em->last = connection->prev;
+        }
+    }
+
+    (connection->prev ? connection->prev->next : head) = connection->next;
+    (connection->next ? connection->next->prev : tail) = connection->prev;
+    connection->signal = nullptr;
+    connection->prev   = connection->next = nullptr;
+}
+
+void wf::typed_signal_base_t::emit(void *data)
+{
+    emission_t emission{head, tail, emissions};
+    emissions = &emission;
+    while (emission.next)
+    {
+        auto current = emission.next;
+        emission.next = (current == emission.last) ? nullptr : current->next;
+        current->emit_erased(data);
+    }
+
+    emissions = emission.outer;
+}
+
 class wf::signal_provider_t::sprovider_impl
 {
   public:
-    std::unordered_map<std::string,
+    std::unordered_map<std::type_index,
+        std::unique_ptr<typed_signal_base_t>> typed_signals;
+
+    /* Indexed by signal_id_t::get_index() */
+    std::unordered_map<uint32_t,
         wf::safe_list_t<signal_connection_t*>> signals;
 
-    std::unordered_map<std::string,
+    std::unordered_map<uint32_t,
         wf::safe_list_t<signal_callback_t*>> deprecated_signals;
+
+    bool empty() const
+    {
+        return signals.empty() && deprecated_signals.empty();
+    }
+
+    /**
+     * Remove the list of the given signal if it has no connections, so that
+     * emitting signals without listeners stays cheap. Lists which are being
+     * iterated are removed when the emission finishes.
+     */
+    template<class List>
+    static void erase_if_unused(
+        std::unordered_map<uint32_t, List>& lists, uint32_t index)
+    {
+        auto it = lists.find(index);
+        if ((it != lists.end()) && (it->second.size() == 0) &&
+            !it->second.is_iterating())
+        {
+            lists.erase(it);
+        }
+    }
 };
 
 wf::signal_provider_t::signal_provider_t()
@@ -86,15 +225,22 @@ wf::signal_provider_t::~signal_provider_t()
 void wf::signal_provider_t::connect_signal(std::string name,
     signal_connection_t *callback)
 {
-    sprovider_priv->signals[name].push_back(callback);
+    connect_signal(signal_id_t{name}, callback);
+}
+
+void wf::signal_provider_t::connect_signal(signal_id_t signal,
+    signal_connection_t *callback)
+{
+    sprovider_priv->signals[signal.get_index()].push_back(callback);
     callback->priv->add(this);
 }
 
 void wf::signal_provider_t::disconnect_signal(signal_connection_t *connection)
 {
-    for (auto& s : sprovider_priv->signals)
+    auto& signals = sprovider_priv->signals;
+    for (auto it = signals.begin(); it != signals.end();)
     {
-        s.second.remove_if([=] (signal_connection_t *connected)
+        it->second.remove_if([=] (signal_connection_t *connected)
         {
             if (connected == connection)
             {
@@ -105,42 +251,127 @@ void wf::signal_provider_t::disconnect_signal(signal_connection_t *connection)
 
             return false;
         });
+
+        if ((it->second.size() == 0) && !it->second.is_iterating())
+        {
+            it = signals.erase(it);
+        } else
+        {
+            ++it;
+        }
+    }
+}
+
+wf::typed_signal_base_t& wf::signal_provider_t::_get_typed_signal(
+    std::type_index type)
+{
+    auto& signal = sprovider_priv->typed_signals[type];
+    if (!signal)
+    {
+        signal = std::make_unique<typed_signal_base_t>();
+    }
+
+    return *signal;
+}
+
+wf::typed_signal_base_t*wf::signal_provider_t::_find_typed_signal(
+    std::type_index type)
+{
+    auto& typed = sprovider_priv->typed_signals;
+    if (typed.empty())
+    {
+        return nullptr;
     }
+
+    auto it = typed.find(type);
+
+    return it == typed.end() ? nullptr : it->second.get();
 }
 
 /* Deprecated: */
 void wf::signal_provider_t::connect_signal(std::string name,
     signal_callback_t *callback)
 {
-    sprovider_priv->deprecated_signals[name].push_back(callback);
+    sprovider_priv->deprecated_signals[signal_id_t{name}.get_index()].push_back(
+        callback);
 }
 
 /* Deprecated: */
 void wf::signal_provider_t::disconnect_signal(std::string name,
     signal_callback_t *callback)
 {
-    sprovider_priv->deprecated_signals[name].remove_all(callback);
+    auto index = signal_id_t{name}.get_index();
+    auto it    = sprovider_priv->deprecated_signals.find(index);
+    if (it != sprovider_priv->deprecated_signals.end())
+    {
+        it->second.remove_all(callback);
+        sprovider_impl::erase_if_unused(sprovider_priv->deprecated_signals, index);
+    }
 }
 
 /* Emit the given signal. No type checking for data is required */
-void wf::signal_provider_t::emit_signal(std::string name, wf::signal_data_t *data)
+void wf::signal_provider_t::emit_signal(const std::string& name,
+    wf::signal_data_t *data)
+{
+    /* Avoid interning the name if nothing is connected at all */
+    if (sprovider_priv->empty())
+    {
+        return;
+    }
+
+    emit_signal(signal_id_t{name}, data);
+}
+
+void wf::signal_provider_t::emit_signal(signal_id_t signal,
+    wf::signal_data_t *data)
 {
-    sprovider_priv->signals[name].for_each([data] (auto call)
+    if (sprovider_priv->empty())
     {
-        call->emit(data);
-    });
+        return;
+    }
+
+    /* The callbacks may connect other signals, which can rehash the maps and
+     * invalidate the iterators, but not references to the lists. The lists
+     * are looked up again afterwards, to remove them if they became unused. */
+    auto index = signal.get_index();
+    auto it    = sprovider_priv->signals.find(index);
+    if (it != sprovider_priv->signals.end())
+    {
+        it->second.for_each([data] (auto call)
+        {
+            call->emit(data);
+        });
+        sprovider_impl::erase_if_unused(sprovider_priv->signals, index);
+    }
 
     /* Deprecated: */
-    sprovider_priv->deprecated_signals[name].for_each([data] (auto call)
+    auto dit = sprovider_priv->deprecated_signals.find(index);
+    if (dit != sprovider_priv->deprecated_signals.end())
     {
-        (*call)(data);
-    });
+        dit->second.for_each([data] (auto call)
+        {
+            (*call)(data);
+        });
+        sprovider_impl::erase_if_unused(sprovider_priv->deprecated_signals, index);
+    }
+}
+
+namespace
+{
+/* The slots of all custom data names used so far */
+std::unordered_map<std::string, uint32_t>& get_data_slots()
+{
+    static std::unordered_map<std::string, uint32_t> data_slots;
+
+    return data_slots;
+}
 }
 
 class wf::object_base_t::obase_impl
 {
   public:
-    std::unordered_map<std::string, std::unique_ptr<custom_data_t>> data;
+    /* Indexed by slot, grows when data is stored in a new slot */
+    std::vector<std::unique_ptr<custom_data_t>> data;
     uint32_t object_id;
 };
 
@@ -165,44 +396,83 @@ uint32_t wf::object_base_t::get_id() const
     return obase_priv->object_id;
 }
 
+uint32_t wf::object_base_t::_data_slot(const std::string& name)
+{
+    auto& slots = get_data_slots();
+    auto it     = slots.find(name);
+    if (it != slots.end())
+    {
+        return it->second;
+    }
+
+    uint32_t slot = slots.size();
+    slots.emplace(name, slot);
+
+    return slot;
+}
+
 bool wf::object_base_t::has_data(std::string name)
 {
-    return obase_priv->data[name] != nullptr;
+    return _fetch_data(_data_slot(name)) != nullptr;
 }
 
 void wf::object_base_t::erase_data(std::string name)
 {
-    auto data = std::move(obase_priv->data[name]);
-    obase_priv->data.erase(name);
-    data.reset();
+    _erase_data(_data_slot(name));
+}
+
+void wf::object_base_t::_erase_data(uint32_t slot)
+{
+    if (slot < obase_priv->data.size())
+    {
+        /* Empty the slot first, in case the destructor accesses the object */
+        auto data = std::move(obase_priv->data[slot]);
+        data.reset();
+    }
 }
 
-wf::custom_data_t*wf::object_base_t::_fetch_data(std::string name)
+wf::custom_data_t*wf::object_base_t::_fetch_data(uint32_t slot)
 {
-    auto it = obase_priv->data.find(name);
-    if (it == obase_priv->data.end())
+    if (slot >= obase_priv->data.size())
     {
         return nullptr;
     }
 
-    return it->second.get();
+    return obase_priv->data[slot].get();
 }
 
-wf::custom_data_t*wf::object_base_t::_fetch_erase(std::string name)
+wf::custom_data_t*wf::object_base_t::_fetch_erase(uint32_t slot)
 {
-    auto data = obase_priv->data[name].release();
-    erase_data(name);
+    if (slot >= obase_priv->data.size())
+    {
+        return nullptr;
+    }
 
-    return data;
+    return obase_priv->data[slot].release();
 }
 
 void wf::object_base_t::_store_data(std::unique_ptr<wf::custom_data_t> data,
-    std::string name)
+    uint32_t slot)
 {
-    obase_priv->data[name] = std::move(data);
+    auto& slots = obase_priv->data;
+    if (slot >= slots.size())
+    {
+        slots.resize(slot + 1);
+    }
+
+    /* Destroy the previous data only after the new data is in place */
+    auto previous = std::move(slots[slot]);
+    slots[slot] = std::move(data);
 }
 
 void wf::object_base_t::_clear_data()
 {
+    /* Data destructors may access the object, so empty each slot before
+     * destroying its data */
+    for (size_t i = 0; i < obase_priv->data.size(); i++)
+    {
+        auto data = std::move(obase_priv->data[i]);
+    }
+
     obase_priv->data.clear();
 }
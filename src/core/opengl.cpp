@@ -1,5 +1,7 @@
 #include <wayfire/util/log.hpp>
+#include <algorithm>
 #include <map>
+#include <vector>
 #include "opengl-priv.hpp"
 #include "wayfire/output.hpp"
 #include "core-impl.hpp"
@@ -91,6 +93,89 @@ GLuint compile_program(std::string vertex_source, std::string frag_source)
     return result_program;
 }
 
+namespace
+{
+/* A quad with corners (0, 0) and (1, 1): positions, then texture coordinates.
+ * The vertex order matches the client-side arrays of
+ * render_transformed_texture(). */
+const GLfloat unit_quad_data[] = {
+    0.0f, 1.0f,
+    1.0f, 1.0f,
+    1.0f, 0.0f,
+    0.0f, 0.0f,
+
+    0.0f, 0.0f,
+    1.0f, 0.0f,
+    1.0f, 1.0f,
+    0.0f, 1.0f,
+};
+
+GLuint unit_quad_vbo = 0;
+
+/** Locations and quad vertex arrays of a built-in program */
+struct builtin_program_t
+{
+    program_location_t position;
+    program_location_t uv_position;
+    program_location_t mvp;
+    program_location_t color;
+
+    /* A vertex array with the unit quad, for each texture type */
+    GLuint quad_vao[wf::TEXTURE_TYPE_ALL] = {0};
+
+    void init(program_t& prog)
+    {
+        position    = prog.get_attrib("position");
+        uv_position = prog.get_attrib("uvPosition");
+        mvp   = prog.get_uniform("MVP");
+        color = prog.get_uniform("color");
+
+        GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, unit_quad_vbo));
+        for (int type = 0; type < wf::TEXTURE_TYPE_ALL; type++)
+        {
+            if (!prog.get_program_id((wf::texture_type_t)type))
+            {
+                continue;
+            }
+
+            GL_CALL(glGenVertexArrays(1, &quad_vao[type]));
+            GL_CALL(glBindVertexArray(quad_vao[type]));
+            setup_attrib(position.location[type], 0);
+            setup_attrib(uv_position.location[type], 8 * sizeof(GLfloat));
+        }
+
+        GL_CALL(glBindVertexArray(0));
+        GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, 0));
+    }
+
+    void fini()
+    {
+        for (auto& vao : quad_vao)
+        {
+            if (vao)
+            {
+                GL_CALL(glDeleteVertexArrays(1, &vao));
+                vao = 0;
+            }
+        }
+    }
+
+  private:
+    static void setup_attrib(int loc, size_t offset)
+    {
+        /* Unused attributes may have been optimized out */
+        if (loc >= 0)
+        {
+            GL_CALL(glEnableVertexAttribArray(loc));
+            GL_CALL(glVertexAttribPointer(loc, 2, GL_FLOAT, GL_FALSE, 0,
+                (const void*)offset));
+        }
+    }
+};
+
+builtin_program_t texture_program_data, color_program_data;
+}
+
 void init()
 {
     render_begin();
@@ -101,21 +186,70 @@ void init()
     color_program.set_simple(compile_program(default_vertex_shader_source,
         color_rect_fragment_source));
 
+    GL_CALL(glGenBuffers(1, &unit_quad_vbo));
+    GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, unit_quad_vbo));
+    GL_CALL(glBufferData(GL_ARRAY_BUFFER, sizeof(unit_quad_data),
+        unit_quad_data, GL_STATIC_DRAW));
+    GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, 0));
+
+    texture_program_data.init(program);
+    color_program_data.init(color_program);
+
     render_end();
 }
 
 void fini()
 {
     render_begin();
+    texture_program_data.fini();
+    color_program_data.fini();
+    GL_CALL(glDeleteBuffers(1, &unit_quad_vbo));
+    unit_quad_vbo = 0;
+
     program.free_resources();
     color_program.free_resources();
     render_end();
 }
 
+/**
+ * Get the matrix which transforms the unit quad to the given geometry.
+ */
+static glm::mat4 unit_quad_transform(const gl_geometry& g)
+{
+    glm::mat4 transform = glm::translate(glm::mat4(1.0), {g.x1, g.y1, 0});
+
+    return glm::scale(transform, {g.x2 - g.x1, g.y2 - g.y1, 1});
+}
+
+/**
+ * Draw the unit quad with the given built-in program. The program should
+ * already be in use.
+ */
+static void draw_unit_quad(const builtin_program_t& data, wf::texture_type_t type)
+{
+    GL_CALL(glBindVertexArray(data.quad_vao[type]));
+    GL_CALL(glDrawArrays(GL_TRIANGLE_FAN, 0, 4));
+    GL_CALL(glBindVertexArray(0));
+}
+
 namespace
 {
 wf::output_t *current_output = NULL;
 uint32_t current_output_fb   = 0;
+
+struct render_target_t
+{
+    int32_t width;
+    int32_t height;
+    uint32_t fb;
+};
+
+/* The targets of the active render_begin() calls, innermost last */
+std::vector<render_target_t> render_targets;
+
+/* Vertex and texture coordinates of batched quads, reused between draws */
+std::vector<GLfloat> batch_vertex_data;
+std::vector<GLfloat> batch_coord_data;
 }
 
 void bind_output(wf::output_t *output, uint32_t fb)
@@ -130,12 +264,32 @@ void unbind_output(wf::output_t *output)
     current_output_fb = 0;
 }
 
+/**
+ * Draw the given vertices with the default program.
+ */
+static void draw_textured_vertices(const wf::texture_t& tex, GLenum mode,
+    GLsizei count, const GLfloat *vertex_data, const GLfloat *coord_data,
+    const glm::mat4& model, const glm::vec4& color)
+{
+    auto& data = texture_program_data;
+    program.use(tex.type);
+    program.set_active_texture(tex);
+    program.attrib_pointer(data.position, 2, 0, vertex_data);
+    program.attrib_pointer(data.uv_position, 2, 0, coord_data);
+    program.uniformMatrix4f(data.mvp, model);
+    program.uniform4f(data.color, color);
+
+    GL_CALL(glEnable(GL_BLEND));
+    GL_CALL(glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA));
+    GL_CALL(glDrawArrays(mode, 0, count));
+
+    program.deactivate();
+}
+
 void render_transformed_texture(wf::texture_t tex,
     const gl_geometry& g, const gl_geometry& texg,
     glm::mat4 model, glm::vec4 color, uint32_t bits)
 {
-    program.use(tex.type);
-
     gl_geometry final_g = g;
     if (bits & TEXTURE_TRANSFORM_INVERT_Y)
     {
@@ -147,6 +301,25 @@ void render_transformed_texture(wf::texture_t tex,
         std::swap(final_g.x1, final_g.x2);
     }
 
+    if (!(bits & TEXTURE_USE_TEX_GEOMETRY))
+    {
+        /* Common case: draw the unit quad from the vertex buffer and move it
+         * in place with the matrix, so nothing has to be uploaded */
+        auto& data = texture_program_data;
+        program.use(tex.type);
+        program.set_active_texture(tex);
+        program.uniformMatrix4f(data.mvp, model * unit_quad_transform(final_g));
+        program.uniform4f(data.color, color);
+
+        GL_CALL(glEnable(GL_BLEND));
+        GL_CALL(glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA));
+        draw_unit_quad(data, tex.type);
+
+        program.deactivate();
+
+        return;
+    }
+
     GLfloat vertexData[] = {
         final_g.x1, final_g.y2,
         final_g.x2, final_g.y2,
@@ -155,35 +328,14 @@ void render_transformed_texture(wf::texture_t tex,
     };
 
     GLfloat coordData[] = {
-        0.0f, 0.0f,
-        1.0f, 0.0f,
-        1.0f, 1.0f,
-        0.0f, 1.0f,
+        texg.x1, texg.y2,
+        texg.x2, texg.y2,
+        texg.x2, texg.y1,
+        texg.x1, texg.y1,
     };
 
-    if (bits & TEXTURE_USE_TEX_GEOMETRY)
-    {
-        coordData[0] = texg.x1;
-        coordData[1] = texg.y2;
-        coordData[2] = texg.x2;
-        coordData[3] = texg.y2;
-        coordData[4] = texg.x2;
-        coordData[5] = texg.y1;
-        coordData[6] = texg.x1;
-        coordData[7] = texg.y1;
-    }
-
-    program.set_active_texture(tex);
-    program.attrib_pointer("position", 2, 0, vertexData);
-    program.attrib_pointer("uvPosition", 2, 0, coordData);
-    program.uniformMatrix4f("MVP", model);
-    program.uniform4f("color", color);
-
-    GL_CALL(glEnable(GL_BLEND));
-    GL_CALL(glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA));
-    GL_CALL(glDrawArrays(GL_TRIANGLE_FAN, 0, 4));
-
-    program.deactivate();
+    draw_textured_vertices(tex, GL_TRIANGLE_FAN, 4, vertexData, coordData,
+        model, color);
 }
 
 void render_transformed_texture(wf::texture_t texture,
@@ -208,27 +360,82 @@ void render_texture(wf::texture_t texture,
         framebuffer.get_orthographic_projection(), color, bits);
 }
 
-void render_rectangle(wf::geometry_t geometry, wf::color_t color,
-    glm::mat4 matrix)
+void render_texture(wf::texture_t texture,
+    const wf::framebuffer_t& framebuffer,
+    const wf::geometry_t& geometry, const wf::region_t& damage,
+    glm::vec4 color, uint32_t bits)
 {
-    color_program.use(wf::TEXTURE_TYPE_RGBA);
-    float x = geometry.x, y = geometry.y,
-        w = geometry.width, h = geometry.height;
+    batch_vertex_data.clear();
+    batch_coord_data.clear();
 
-    GLfloat vertexData[] = {
-        x, y + h,
-        x + w, y + h,
-        x + w, y,
-        x, y,
+    auto push_vertex = [&] (float x, float y)
+    {
+        /* Same mapping as the coordinates in render_transformed_texture():
+         * the bottom-left corner of the geometry is (0, 0) */
+        float u = (x - geometry.x) / geometry.width;
+        float v = 1.0f - (y - geometry.y) / geometry.height;
+        if (bits & TEXTURE_TRANSFORM_INVERT_X)
+        {
+            u = 1.0f - u;
+        }
+
+        if (bits & TEXTURE_TRANSFORM_INVERT_Y)
+        {
+            v = 1.0f - v;
+        }
+
+        batch_vertex_data.push_back(x);
+        batch_vertex_data.push_back(y);
+        batch_coord_data.push_back(u);
+        batch_coord_data.push_back(v);
     };
 
-    color_program.attrib_pointer("position", 2, 0, vertexData);
-    color_program.uniformMatrix4f("MVP", matrix);
-    color_program.uniform4f("color", {color.r, color.g, color.b, color.a});
+    for (const auto& rect : damage)
+    {
+        float x1 = std::max(rect.x1, geometry.x);
+        float y1 = std::max(rect.y1, geometry.y);
+        float x2 = std::min(rect.x2, geometry.x + geometry.width);
+        float y2 = std::min(rect.y2, geometry.y + geometry.height);
+        if ((x1 >= x2) || (y1 >= y2))
+        {
+            continue;
+        }
+
+        push_vertex(x1, y1);
+        push_vertex(x2, y1);
+        push_vertex(x2, y2);
+        push_vertex(x1, y1);
+        push_vertex(x2, y2);
+        push_vertex(x1, y2);
+    }
+
+    if (batch_vertex_data.empty())
+    {
+        return;
+    }
+
+    draw_textured_vertices(texture, GL_TRIANGLES, batch_vertex_data.size() / 2,
+        batch_vertex_data.data(), batch_coord_data.data(),
+        framebuffer.get_orthographic_projection(), color);
+}
+
+void render_rectangle(wf::geometry_t geometry, wf::color_t color,
+    glm::mat4 matrix)
+{
+    gl_geometry g;
+    g.x1 = geometry.x;
+    g.y1 = geometry.y;
+    g.x2 = g.x1 + geometry.width;
+    g.y2 = g.y1 + geometry.height;
+
+    auto& data = color_program_data;
+    color_program.use(wf::TEXTURE_TYPE_RGBA);
+    color_program.uniformMatrix4f(data.mvp, matrix * unit_quad_transform(g));
+    color_program.uniform4f(data.color, {color.r, color.g, color.b, color.a});
 
     GL_CALL(glEnable(GL_BLEND));
     GL_CALL(glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA));
-    GL_CALL(glDrawArrays(GL_TRIANGLE_FAN, 0, 4));
+    draw_unit_quad(data, wf::TEXTURE_TYPE_RGBA);
 
     color_program.deactivate();
 }
@@ -244,16 +451,56 @@ void render_begin(const wf::framebuffer_base_t& fb)
     render_begin(fb.viewport_width, fb.viewport_height, fb.fb);
 }
 
+/**
+ * Switch from the previous render target (if any) to the given one.
+ *
+ * @param force_bind Bind the framebuffer and reset the viewport even if the
+ *   previous target used the same ones.
+ */
+static void switch_render_target(const render_target_t& target,
+    const render_target_t *previous, bool force_bind)
+{
+    auto renderer = wf::get_core_impl().renderer;
+    bool same_size = previous && (previous->width == target.width) &&
+        (previous->height == target.height);
+
+    if (!same_size)
+    {
+        /* The wlroots renderer keeps a projection for the viewport size */
+        if (previous)
+        {
+            wlr_renderer_end(renderer);
+        }
+
+        wlr_renderer_begin(renderer, target.width, target.height);
+    } else if (force_bind)
+    {
+        GL_CALL(glViewport(0, 0, target.width, target.height));
+    }
+
+    if (!previous || force_bind || (previous->fb != target.fb))
+    {
+        GL_CALL(glBindFramebuffer(GL_FRAMEBUFFER, target.fb));
+    }
+}
+
 void render_begin(int32_t viewport_width, int32_t viewport_height, uint32_t fb)
 {
-    if (!wlr_egl_is_current(wf::get_core_impl().egl))
+    render_target_t target{viewport_width, viewport_height, fb};
+    if (render_targets.empty())
     {
-        wlr_egl_make_current(wf::get_core_impl().egl, EGL_NO_SURFACE, NULL);
+        if (!wlr_egl_is_current(wf::get_core_impl().egl))
+        {
+            wlr_egl_make_current(wf::get_core_impl().egl, EGL_NO_SURFACE, NULL);
+        }
+
+        switch_render_target(target, nullptr, true);
+    } else
+    {
+        switch_render_target(target, &render_targets.back(), false);
     }
 
-    wlr_renderer_begin(wf::get_core_impl().renderer,
-        viewport_width, viewport_height);
-    GL_CALL(glBindFramebuffer(GL_FRAMEBUFFER, fb));
+    render_targets.push_back(target);
 }
 
 void clear(wf::color_t col, uint32_t mask)
@@ -264,9 +511,20 @@ void clear(wf::color_t col, uint32_t mask)
 
 void render_end()
 {
-    GL_CALL(glBindFramebuffer(GL_FRAMEBUFFER, current_output_fb));
+    auto ended = render_targets.back();
+    render_targets.pop_back();
+
     wlr_renderer_scissor(wf::get_core().renderer, NULL);
-    wlr_renderer_end(wf::get_core().renderer);
+    if (render_targets.empty())
+    {
+        GL_CALL(glBindFramebuffer(GL_FRAMEBUFFER, current_output_fb));
+        wlr_renderer_end(wf::get_core().renderer);
+    } else
+    {
+        /* The nested block may have bound other framebuffers or changed the
+         * viewport without going through render_begin(), so always restore */
+        switch_render_target(render_targets.back(), &ended, true);
+    }
 }
 }
 
@@ -539,11 +797,25 @@ namespace OpenGL
 class program_t::impl
 {
   public:
-    std::set<int> active_attrs;
-    std::set<int> active_attrs_divisors;
+    /* Small vectors instead of sets, so that they keep their storage and
+     * activating attributes does not allocate on every draw */
+    std::vector<int> active_attrs;
+    std::vector<int> active_attrs_divisors;
 
     int active_program_idx = 0;
 
+    /* Locations of the builtin uniforms used by set_active_texture() */
+    bool builtins_resolved = false;
+    program_location_t y_base, y_mult;
+
+    static void add_active(std::vector<int>& list, int loc)
+    {
+        if (std::find(list.begin(), list.end(), loc) == list.end())
+        {
+            list.push_back(loc);
+        }
+    }
+
     int id[wf::TEXTURE_TYPE_ALL];
     std::map<std::string, int> uniforms[wf::TEXTURE_TYPE_ALL];
 
@@ -643,6 +915,7 @@ void program_t::compile(const std::string& vertex_source,
 
 void program_t::free_resources()
 {
+    priv->builtins_resolved = false;
     for (int i = 0; i < wf::TEXTURE_TYPE_ALL; i++)
     {
         if (this->priv->id[i])
@@ -670,6 +943,36 @@ int program_t::get_program_id(wf::texture_type_t type)
     return priv->id[type];
 }
 
+program_location_t program_t::get_uniform(const std::string& name)
+{
+    program_location_t result;
+    for (int i = 0; i < wf::TEXTURE_TYPE_ALL; i++)
+    {
+        if (priv->id[i])
+        {
+            result.location[i] =
+                GL_CALL(glGetUniformLocation(priv->id[i], name.c_str()));
+        }
+    }
+
+    return result;
+}
+
+program_location_t program_t::get_attrib(const std::string& name)
+{
+    program_location_t result;
+    for (int i = 0; i < wf::TEXTURE_TYPE_ALL; i++)
+    {
+        if (priv->id[i])
+        {
+            result.location[i] =
+                GL_CALL(glGetAttribLocation(priv->id[i], name.c_str()));
+        }
+    }
+
+    return result;
+}
+
 void program_t::uniform1i(const std::string& name, int value)
 {
     int loc = priv->find_uniform_loc(name);
@@ -706,20 +1009,74 @@ void program_t::uniformMatrix4f(const std::string& name, const glm::mat4& value)
     GL_CALL(glUniformMatrix4fv(loc, 1, GL_FALSE, &value[0][0]));
 }
 
+void program_t::uniform1i(const program_location_t& uniform, int value)
+{
+    int loc = uniform.location[priv->active_program_idx];
+    GL_CALL(glUniform1i(loc, value));
+}
+
+void program_t::uniform1f(const program_location_t& uniform, float value)
+{
+    int loc = uniform.location[priv->active_program_idx];
+    GL_CALL(glUniform1f(loc, value));
+}
+
+void program_t::uniform2f(const program_location_t& uniform, float x, float y)
+{
+    int loc = uniform.location[priv->active_program_idx];
+    GL_CALL(glUniform2f(loc, x, y));
+}
+
+void program_t::uniform3f(const program_location_t& uniform,
+    float x, float y, float z)
+{
+    int loc = uniform.location[priv->active_program_idx];
+    GL_CALL(glUniform3f(loc, x, y, z));
+}
+
+void program_t::uniform4f(const program_location_t& uniform,
+    const glm::vec4& value)
+{
+    int loc = uniform.location[priv->active_program_idx];
+    GL_CALL(glUniform4f(loc, value.r, value.g, value.b, value.a));
+}
+
+void program_t::uniformMatrix4f(const program_location_t& uniform,
+    const glm::mat4& value)
+{
+    int loc = uniform.location[priv->active_program_idx];
+    GL_CALL(glUniformMatrix4fv(loc, 1, GL_FALSE, &value[0][0]));
+}
+
 void program_t::attrib_pointer(const std::string& attrib,
     int size, int stride, const void *ptr, GLenum type)
 {
-    int loc = priv->find_attrib_loc(attrib);
-    priv->active_attrs.insert(loc);
+    program_location_t location;
+    location.location[priv->active_program_idx] = priv->find_attrib_loc(attrib);
+    attrib_pointer(location, size, stride, ptr, type);
+}
+
+void program_t::attrib_divisor(const std::string& attrib, int divisor)
+{
+    program_location_t location;
+    location.location[priv->active_program_idx] = priv->find_attrib_loc(attrib);
+    attrib_divisor(location, divisor);
+}
+
+void program_t::attrib_pointer(const program_location_t& attrib,
+    int size, int stride, const void *ptr, GLenum type)
+{
+    int loc = attrib.location[priv->active_program_idx];
+    impl::add_active(priv->active_attrs, loc);
 
     GL_CALL(glEnableVertexAttribArray(loc));
     GL_CALL(glVertexAttribPointer(loc, size, type, GL_FALSE, stride, ptr));
 }
 
-void program_t::attrib_divisor(const std::string& attrib, int divisor)
+void program_t::attrib_divisor(const program_location_t& attrib, int divisor)
 {
-    int loc = priv->find_attrib_loc(attrib);
-    priv->active_attrs_divisors.insert(loc);
+    int loc = attrib.location[priv->active_program_idx];
+    impl::add_active(priv->active_attrs_divisors, loc);
     GL_CALL(glVertexAttribDivisor(loc, divisor));
 }
 
@@ -729,8 +1086,15 @@ void program_t::set_active_texture(const wf::texture_t& texture)
     GL_CALL(glBindTexture(texture.target, texture.tex_id));
     GL_CALL(glTexParameteri(texture.target, GL_TEXTURE_MIN_FILTER, GL_LINEAR));
 
-    uniform1f("_wayfire_y_base", texture.invert_y ? 1 : 0);
-    uniform1f("_wayfire_y_mult", texture.invert_y ? -1 : 1);
+    if (!priv->builtins_resolved)
+    {
+        priv->y_base = get_uniform("_wayfire_y_base");
+        priv->y_mult = get_uniform("_wayfire_y_mult");
+        priv->builtins_resolved = true;
+    }
+
+    uniform1f(priv->y_base, texture.invert_y ? 1 : 0);
+    uniform1f(priv->y_mult, texture.invert_y ? -1 : 1);
 }
 
 void program_t::deactivate()
@@ -12,6 +12,11 @@
 #include "core-impl.hpp"
 
 #include <xf86drmMode.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <deque>
 #include <sstream>
 #include <cstring>
 #include <unordered_set>
@@ -343,6 +348,11 @@ struct output_layout_output_t
         }
     }
 
+    ~output_layout_output_t()
+    {
+        destroy_mirror_textures();
+    }
+
     /**
      * Update the current configuration based on the mode set by the
      * backend.
@@ -685,14 +695,204 @@ struct output_layout_output_t
     wl_listener_wrapper on_frame;
     wlr_output *locked_cursors_on = NULL;
 
-    /** Render the output using texture as source */
-    void render_output(wlr_texture *texture)
+    /**
+     * A texture imported from one of the buffers of the mirrored output.
+     * The mirrored output cycles through a few buffers, so the textures are
+     * kept and reused instead of importing the buffer again on each frame.
+     * Buffers are identified by the inode of their dmabuf.
+     */
+    struct mirror_texture_t
+    {
+        dev_t dev;
+        ino_t ino;
+        int32_t width, height;
+        uint32_t format;
+        uint64_t modifier;
+        wlr_texture *texture;
+        uint64_t last_used;
+    };
+
+    static constexpr size_t MAX_MIRROR_TEXTURES = 4;
+    std::vector<mirror_texture_t> mirror_textures;
+
+    /* Damage of the mirrored output since our last frame, in its buffer
+     * coordinates */
+    wf::region_t mirror_source_damage;
+    bool mirror_source_damage_whole = true;
+    wf::dimensions_t last_source_size = {0, 0};
+
+    /* Damage of our last frames, newest first, used for buffer age */
+    static constexpr size_t MIRROR_DAMAGE_HISTORY = 4;
+    std::deque<wf::region_t> mirror_damage_history;
+
+    struct mirror_stats_t
+    {
+        uint64_t frames = 0;
+        uint64_t imports = 0;
+        uint64_t skipped = 0;
+        int64_t total_ns = 0;
+        int64_t max_ns   = 0;
+        /* Sum of the repainted fraction of the output, in percent */
+        int64_t repainted_percent = 0;
+    } mirror_stats;
+
+    wf::signal_connection_t on_dump_stats = [=] (wf::signal_data_t*)
+    {
+        if (!on_frame.is_connected())
+        {
+            return;
+        }
+
+        auto& st = mirror_stats;
+        uint64_t frames = std::max<uint64_t>(st.frames, 1);
+        LOGI("Mirror statistics for output ", handle->name, ": ",
+            st.frames, " frames, ", st.skipped, " without damage, ",
+            st.imports, " buffer imports, avg ",
+            st.total_ns / frames / 1000, "us max ", st.max_ns / 1000,
+            "us per frame, avg ", st.repainted_percent / (int64_t)frames,
+            "% of the output repainted");
+    };
+
+    void destroy_mirror_textures()
+    {
+        for (auto& tex : mirror_textures)
+        {
+            wlr_texture_destroy(tex.texture);
+        }
+
+        mirror_textures.clear();
+    }
+
+    /**
+     * Find or import the texture for the exported buffer.
+     */
+    wlr_texture *get_mirror_texture(const wlr_dmabuf_attributes& attributes)
+    {
+        struct stat st;
+        if (fstat(attributes.fd[0], &st) != 0)
+        {
+            return nullptr;
+        }
+
+        for (auto& tex : mirror_textures)
+        {
+            if ((tex.dev == st.st_dev) && (tex.ino == st.st_ino) &&
+                (tex.width == attributes.width) &&
+                (tex.height == attributes.height) &&
+                (tex.format == attributes.format) &&
+                (tex.modifier == attributes.modifier))
+            {
+                tex.last_used = mirror_stats.frames;
+
+                return tex.texture;
+            }
+        }
+
+        auto texture = wlr_texture_from_dmabuf(get_core().renderer,
+            const_cast<wlr_dmabuf_attributes*>(&attributes));
+        if (!texture)
+        {
+            return nullptr;
+        }
+
+        ++mirror_stats.imports;
+        if (mirror_textures.size() >= MAX_MIRROR_TEXTURES)
+        {
+            auto lru = std::min_element(mirror_textures.begin(),
+                mirror_textures.end(), [] (const auto& a, const auto& b)
+            {
+                return a.last_used < b.last_used;
+            });
+            wlr_texture_destroy(lru->texture);
+            mirror_textures.erase(lru);
+        }
+
+        mirror_textures.push_back({st.st_dev, st.st_ino, attributes.width,
+            attributes.height, attributes.format, attributes.modifier,
+            texture, mirror_stats.frames});
+
+        return texture;
+    }
+
+    /**
+     * Convert the accumulated damage of the mirrored output to our buffer
+     * coordinates, and reset it.
+     */
+    wf::region_t take_mirror_damage(const wlr_dmabuf_attributes& attributes)
+    {
+        wlr_box whole = {0, 0, handle->width, handle->height};
+        wf::dimensions_t source_size = {attributes.width, attributes.height};
+        if (mirror_source_damage_whole || (source_size != last_source_size))
+        {
+            last_source_size = source_size;
+            mirror_source_damage_whole = false;
+            mirror_source_damage.clear();
+
+            return whole;
+        }
+
+        /* The damage is in the coordinates of the displayed image, which
+         * is stretched over our whole output */
+        double sx = 1.0 * handle->width / attributes.width;
+        double sy = 1.0 * handle->height / attributes.height;
+
+        wf::region_t damage;
+        for (const auto& rect : mirror_source_damage)
+        {
+            int x1 = std::floor(rect.x1 * sx);
+            int y1 = std::floor(rect.y1 * sy);
+            int x2 = std::ceil(rect.x2 * sx);
+            int y2 = std::ceil(rect.y2 * sy);
+            damage |= wlr_box{x1, y1, x2 - x1, y2 - y1};
+        }
+
+        mirror_source_damage.clear();
+        if ((sx != 1.0) || (sy != 1.0))
+        {
+            /* Linear filtering samples neighbouring pixels too */
+            damage.expand_edges(1);
+        }
+
+        return damage & whole;
+    }
+
+    /** Render the damaged part of the output using texture as source */
+    void render_output(wlr_texture *texture, const wf::region_t& damage)
     {
         auto renderer = get_core().renderer;
-        wlr_output_attach_render(handle, NULL);
+        int buffer_age;
+        if (!wlr_output_attach_render(handle, &buffer_age))
+        {
+            /* The damage was already taken, repaint everything next time */
+            mirror_source_damage_whole = true;
+
+            return;
+        }
+
+        mirror_damage_history.push_front(damage);
+        if (mirror_damage_history.size() > MIRROR_DAMAGE_HISTORY)
+        {
+            mirror_damage_history.pop_back();
+        }
+
+        /* The buffer contains the contents from buffer_age frames ago */
+        wf::region_t repaint;
+        if ((buffer_age <= 0) ||
+            ((size_t)buffer_age > mirror_damage_history.size()))
+        {
+            repaint |= wlr_box{0, 0, handle->width, handle->height};
+        } else
+        {
+            for (int i = 0; i < buffer_age; i++)
+            {
+                repaint |= mirror_damage_history[i];
+            }
+        }
+
         wlr_renderer_begin(renderer, handle->width, handle->height);
 
-        /* Project a box filling the whole screen */
+        /* Project a box filling the whole screen, the texture is scaled to
+         * our resolution in the same blit */
         float projection[9], box[9];
         wlr_matrix_projection(projection, handle->width, handle->height,
             WL_OUTPUT_TRANSFORM_NORMAL);
@@ -701,11 +901,55 @@ struct output_layout_output_t
         wlr_matrix_project_box(box, &geometry, WL_OUTPUT_TRANSFORM_NORMAL,
             0.0, projection);
 
-        wlr_render_texture_with_matrix(renderer, texture, box, 1.0);
+        for (const auto& rect : repaint)
+        {
+            wlr_box scissor = wlr_box_from_pixman_box(rect);
+            wlr_renderer_scissor(renderer, &scissor);
+            wlr_render_texture_with_matrix(renderer, texture, box, 1.0);
+        }
+
+        wlr_renderer_scissor(renderer, NULL);
         wlr_renderer_end(renderer);
+
+        int64_t area = int64_t(handle->width) * handle->height;
+        int64_t repainted = 0;
+        for (const auto& rect : repaint)
+        {
+            repainted += int64_t(rect.x2 - rect.x1) * (rect.y2 - rect.y1);
+        }
+
+        mirror_stats.repainted_percent += area > 0 ? repainted * 100 / area : 0;
+
+        /* Only the new damage changes what is shown */
+        wlr_output_set_damage(handle,
+            const_cast<wf::region_t&>(damage).to_pixman());
         wlr_output_commit(handle);
     }
 
+    /**
+     * The mirrored output is about to commit a new frame. Collect its damage.
+     */
+    void handle_mirrored_precommit(wlr_output *source)
+    {
+        if (!(source->pending.committed & WLR_OUTPUT_STATE_BUFFER))
+        {
+            return;
+        }
+
+        if (source->pending.committed & WLR_OUTPUT_STATE_DAMAGE)
+        {
+            pixman_region32_union(mirror_source_damage.to_pixman(),
+                mirror_source_damage.to_pixman(), &source->pending.damage);
+        } else
+        {
+            mirror_source_damage_whole = true;
+        }
+
+        /* The mirrored output was repainted, schedule repaint
+         * for us as well */
+        wlr_output_schedule_frame(handle);
+    }
+
     /* Load output contents and render them */
     void handle_frame()
     {
@@ -719,6 +963,14 @@ struct output_layout_output_t
             return;
         }
 
+        if (mirror_source_damage.empty() && !mirror_source_damage_whole)
+        {
+            ++mirror_stats.skipped;
+
+            return;
+        }
+
+        auto start = std::chrono::steady_clock::now();
         wlr_dmabuf_attributes attributes;
         if (!wlr_output_export_dmabuf(wo->handle, &attributes))
         {
@@ -727,14 +979,22 @@ struct output_layout_output_t
             return;
         }
 
-        /* We export the output to mirror from to a dmabuf, then create
-         * a texture from this and use it to render "our" output */
-        auto texture = wlr_texture_from_dmabuf(
-            get_core().renderer, &attributes);
-        render_output(texture);
+        /* We export the output to mirror from to a dmabuf, then use the
+         * texture created from this buffer to render "our" output */
+        auto texture = get_mirror_texture(attributes);
+        if (texture)
+        {
+            auto damage = take_mirror_damage(attributes);
+            render_output(texture, damage);
+        }
 
-        wlr_texture_destroy(texture);
         wlr_dmabuf_attributes_finish(&attributes);
+
+        int64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count();
+        ++mirror_stats.frames;
+        mirror_stats.total_ns += ns;
+        mirror_stats.max_ns    = std::max(mirror_stats.max_ns, ns);
     }
 
     void set_enabled(bool enabled)
@@ -787,17 +1047,20 @@ struct output_layout_output_t
         wlr_output_lock_software_cursors(wo->handle, true);
         locked_cursors_on = wo->handle;
 
+        mirror_source_damage_whole = true;
+        mirror_damage_history.clear();
+        mirror_stats = {};
+
         wlr_output_schedule_frame(handle);
         on_mirrored_frame.set_callback([=] (void*)
         {
-            /* The mirrored output was repainted, schedule repaint
-             * for us as well */
-            wlr_output_schedule_frame(handle);
+            handle_mirrored_precommit(wo->handle);
         });
         on_mirrored_frame.connect(&wo->handle->events.precommit);
 
         on_frame.set_callback([=] (void*) { handle_frame(); });
         on_frame.connect(&handle->events.frame);
+        get_core().connect_signal("dump-stats", &on_dump_stats);
     }
 
     void teardown_mirror()
@@ -810,6 +1073,8 @@ struct output_layout_output_t
 
         on_mirrored_frame.disconnect();
         on_frame.disconnect();
+        on_dump_stats.disconnect();
+        destroy_mirror_textures();
     }
 
     wf::dimensions_t get_effective_size()
@@ -1,5 +1,6 @@
 #include <cassert>
 #include <algorithm>
+#include <cmath>
 #include "pointer.hpp"
 #include "surface-map-state.hpp"
 #include "wayfire/signal-definitions.hpp"
@@ -18,6 +19,21 @@
 #include "tablet.hpp"
 #include "pointing-device.hpp"
 
+/** @return The position and size of each surface in the view's tree. */
+static std::vector<std::pair<wf::surface_interface_t*, wf::geometry_t>>
+get_surface_layout(wayfire_view view)
+{
+    std::vector<std::pair<wf::surface_interface_t*, wf::geometry_t>> layout;
+    for (auto& child : view->enumerate_surfaces({0, 0}))
+    {
+        auto size = child.surface->get_size();
+        layout.push_back({child.surface, {child.position.x, child.position.y,
+            size.width, size.height}});
+    }
+
+    return layout;
+}
+
 static std::unique_ptr<wf::input_device_impl_t> create_wf_device_for_device(
     wlr_input_device *device)
 {
@@ -151,11 +167,38 @@ wf::input_manager_t::input_manager_t()
         refresh_device_mappings();
     };
     wf::get_core().output_layout->connect_signal("output-added", &output_added);
+
+    hit_cache.on_view_damaged.set_callback([=] (wf::signal_data_t*)
+    {
+        if (get_surface_layout(hit_cache.view) != hit_cache.layout)
+        {
+            invalidate_hit_cache();
+        }
+    });
+    hit_cache.on_commit.set_callback([=] (void*)
+    {
+        auto wlr_surface = hit_cache.surface->get_wlr_surface();
+        if ((hit_cache.surface->get_size() != hit_cache.size) ||
+            !pixman_region32_equal(&wlr_surface->input_region,
+                hit_cache.input_region.to_pixman()))
+        {
+            invalidate_hit_cache();
+        }
+    });
+    hit_cache.on_destroy.set_callback([=] (void*) { invalidate_hit_cache(); });
+
+    on_dump_stats = [=] (wf::signal_data_t*)
+    {
+        LOGI("Input hit-test cache: ", hit_cache_hits, " hits, ",
+            hit_cache_misses, " misses");
+    };
+    wf::get_core().connect_signal("dump-stats", &on_dump_stats);
 }
 
 wf::input_manager_t::~input_manager_t()
 {
     wf::get_core().disconnect_signal("reload-config", &config_updated);
+    wf::get_core().disconnect_signal("dump-stats", &on_dump_stats);
     wf::get_core().output_layout->disconnect_signal(
         "output-added", &output_added);
 }
@@ -249,27 +292,128 @@ wf::surface_interface_t*wf::input_manager_t::input_surface_at(
     global.x -= og.x;
     global.y -= og.y;
 
-    for (auto& v : output->workspace->get_views_in_layer(wf::VISIBLE_LAYERS))
+    if ((hit_cache.output == output) && hit_cache.region.contains_pointf(global) &&
+        (hit_cache.serial == output->workspace->get_views_serial()))
+    {
+        ++hit_cache_hits;
+        local.x = global.x - hit_cache.origin.x;
+        local.y = global.y - hit_cache.origin.y;
+
+        return hit_cache.surface;
+    }
+
+    ++hit_cache_misses;
+    for (auto& view : output->workspace->get_views_at(global, wf::VISIBLE_LAYERS))
     {
-        for (auto& view : v->enumerate_views())
+        if (!view->minimized && can_focus_surface(view.get()))
         {
-            if (!view->minimized && can_focus_surface(view.get()))
+            auto surface = view->map_input_coordinates(global, local);
+            if (surface)
             {
-                auto surface = view->map_input_coordinates(global, local);
-                if (surface)
-                {
-                    return surface;
-                }
+                update_hit_cache(output, view, surface, global, local);
+
+                return surface;
             }
         }
     }
 
+    invalidate_hit_cache();
+
     return nullptr;
 }
 
+void wf::input_manager_t::update_hit_cache(wf::output_t *output,
+    wayfire_view view, wf::surface_interface_t *surface, wf::pointf_t point,
+    wf::pointf_t local)
+{
+    invalidate_hit_cache();
+
+    /* Only surfaces whose input region is known, see accepts_input() */
+    auto wlr_surface = surface->get_wlr_surface();
+    if (!wlr_surface || view->has_transformer())
+    {
+        return;
+    }
+
+    wf::point_t origin = {
+        (int)std::round(point.x - local.x),
+        (int)std::round(point.y - local.y),
+    };
+    if ((std::abs(point.x - local.x - origin.x) > 1e-3) ||
+        (std::abs(point.y - local.y - origin.y) > 1e-3))
+    {
+        return;
+    }
+
+    auto size = surface->get_size();
+    wf::region_t region{&wlr_surface->input_region};
+    region &= wf::geometry_t{0, 0, size.width, size.height};
+    region += origin;
+
+    /* Subtract the surfaces of the view which are tried before this one */
+    wf::point_t view_origin = origin;
+    auto surfaces = view->enumerate_surfaces({0, 0});
+    for (auto& child : surfaces)
+    {
+        if (child.surface == surface)
+        {
+            view_origin = origin - child.position;
+            break;
+        }
+    }
+
+    for (auto& child : surfaces)
+    {
+        if (child.surface == surface)
+        {
+            break;
+        }
+
+        auto child_size = child.surface->get_size();
+        region ^= wf::geometry_t{
+            view_origin.x + child.position.x, view_origin.y + child.position.y,
+            child_size.width, child_size.height};
+    }
+
+    auto extents = wlr_box_from_pixman_box(region.get_extents());
+    region &= output->workspace->get_exposed_region(view, extents,
+        wf::VISIBLE_LAYERS);
+    if (!region.contains_pointf(point))
+    {
+        return;
+    }
+
+    hit_cache.output  = output;
+    hit_cache.serial  = output->workspace->get_views_serial();
+    hit_cache.surface = surface;
+    hit_cache.origin  = origin;
+    hit_cache.region  = std::move(region);
+    hit_cache.view    = view;
+    hit_cache.size    = size;
+    hit_cache.layout  = get_surface_layout(view);
+
+    hit_cache.input_region = wf::region_t{&wlr_surface->input_region};
+    view->connect_signal("region-damaged", &hit_cache.on_view_damaged);
+    hit_cache.on_commit.connect(&wlr_surface->events.commit);
+    hit_cache.on_destroy.connect(&wlr_surface->events.destroy);
+}
+
+void wf::input_manager_t::invalidate_hit_cache()
+{
+    hit_cache.output  = nullptr;
+    hit_cache.surface = nullptr;
+    hit_cache.region.clear();
+    hit_cache.view = nullptr;
+    hit_cache.layout.clear();
+    hit_cache.on_view_damaged.disconnect();
+    hit_cache.on_commit.disconnect();
+    hit_cache.on_destroy.disconnect();
+}
+
 void wf::input_manager_t::set_exclusive_focus(wl_client *client)
 {
     exclusive_client = client;
+    invalidate_hit_cache();
     for (auto& wo : wf::get_core().output_layout->get_outputs())
     {
         auto impl = (wf::output_impl_t*)wo;
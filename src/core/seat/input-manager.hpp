@@ -29,6 +29,50 @@ class input_manager_t
 
     wf::signal_callback_t config_updated;
     wf::signal_callback_t output_added;
+    wf::signal_callback_t on_dump_stats;
+
+    /**
+     * The result of the last input_surface_at() query. It is reused for the
+     * following queries while the point stays inside the region where the
+     * surface is hit, and the views on the output do not change.
+     */
+    struct hit_cache_t
+    {
+        wf::output_t *output = nullptr;
+        /* The views serial of the output, see workspace_manager */
+        uint64_t serial = 0;
+        wf::surface_interface_t *surface = nullptr;
+        /* Surface-local coordinates are output-local coordinates - origin */
+        wf::point_t origin = {0, 0};
+        /* Where the surface is hit, in output-local coordinates */
+        wf::region_t region;
+
+        /* The state the region was computed from, so that commits and damage
+         * which do not change it can keep the cache */
+        wayfire_view view;
+        wf::region_t input_region;
+        wf::dimensions_t size = {0, 0};
+        std::vector<std::pair<wf::surface_interface_t*, wf::geometry_t>> layout;
+
+        /* Changes inside the view, like moving subsurfaces, do not change the
+         * serial, so the view's surface layout is checked on damage. Changes
+         * of the input region are caught by the surface commit. */
+        wf::signal_connection_t on_view_damaged;
+        wf::wl_listener_wrapper on_commit;
+        wf::wl_listener_wrapper on_destroy;
+    } hit_cache;
+
+    uint64_t hit_cache_hits   = 0;
+    uint64_t hit_cache_misses = 0;
+
+    /**
+     * Fill the hit cache after a surface was found at the given point.
+     * Views with transformers are not cached, because the surface coordinates
+     * are not a translation of the output coordinates for them.
+     */
+    void update_hit_cache(wf::output_t *output, wayfire_view view,
+        wf::surface_interface_t *surface, wf::pointf_t point, wf::pointf_t local);
+    void invalidate_hit_cache();
 
   public:
     /**
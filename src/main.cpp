@@ -10,7 +10,6 @@
 
 #include "debug-func.hpp"
 #include "main.hpp"
-#include "wayfire/nonstd/safe-list.hpp"
 #include <wayfire/config/file.hpp>
 
 #include <wayland-server.h>
@@ -46,6 +45,14 @@ static int handle_config_updated(int fd, uint32_t mask, void *data)
     return 0;
 }
 
+static int handle_dump_stats(int signal, void *data)
+{
+    LOGI("Dumping debug statistics");
+    wf::get_core().emit_signal("dump-stats", nullptr);
+
+    return 0;
+}
+
 static void print_version()
 {
     std::cout << WAYFIRE_VERSION << std::endl;
@@ -67,19 +74,6 @@ static void print_help()
     exit(0);
 }
 
-namespace wf
-{
-namespace _safe_list_detail
-{
-wl_event_loop *event_loop;
-void idle_cleanup_func(void *data)
-{
-    auto priv = reinterpret_cast<std::function<void()>*>(data);
-    (*priv)();
-}
-}
-}
-
 static bool drop_permissions(void)
 {
     if ((getuid() != geteuid()) || (getgid() != getegid()))
@@ -254,10 +248,7 @@ int main(int argc, char *argv[])
 #endif
 
     LOGI("Starting wayfire version ", WAYFIRE_VERSION);
-    /* First create display and initialize safe-list's event loop, so that
-     * wf objects (which depend on safe-list) can work */
     auto display = wl_display_create();
-    wf::_safe_list_detail::event_loop = wl_display_get_event_loop(display);
 
     auto& core = wf::get_core_impl();
 
@@ -299,6 +290,7 @@ int main(int argc, char *argv[])
 
     wl_event_loop_add_fd(core.ev_loop, inotify_fd, WL_EVENT_READABLE,
         handle_config_updated, NULL);
+    wl_event_loop_add_signal(core.ev_loop, SIGUSR1, handle_dump_stats, NULL);
     core.init();
 
     auto socket = choose_socket(core.display);
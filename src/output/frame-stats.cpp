@@ -0,0 +1,426 @@
+#include "frame-stats.hpp"
+#include "config.h"
+#include <wayfire/output.hpp>
+#include <wayfire/util/log.hpp>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+
+#ifndef GL_TIME_ELAPSED_EXT
+    #define GL_TIME_ELAPSED_EXT 0x88BF
+#endif
+
+#ifndef GL_GPU_DISJOINT_EXT
+    #define GL_GPU_DISJOINT_EXT 0x8FBB
+#endif
+
+#ifdef WF_ALLOC_STATS
+/* Only allocations on the compositor thread are interesting for the frame
+ * statistics, so the counter is thread-local and needs no synchronization.
+ * The array and nothrow forms of new and delete forward to these. */
+static thread_local uint64_t heap_allocations = 0;
+
+void *operator new(size_t size)
+{
+    ++heap_allocations;
+    if (void *ptr = std::malloc(size ? size : 1))
+    {
+        return ptr;
+    }
+
+    throw std::bad_alloc();
+}
+
+void operator delete(void *ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept
+{
+    std::free(ptr);
+}
+
+#endif
+
+namespace wf
+{
+static const char *phase_names[FRAME_PHASE_TOTAL] = {
+    "effects",
+    "scanout",
+    "attach",
+    "render",
+    "overlay",
+    "cursors",
+    "post",
+    "swap",
+};
+
+static const char *scanout_status_names[SCANOUT_STATUS_TOTAL] = {
+    "success",
+    "disabled",
+    "effects",
+    "no candidate",
+    "transformer",
+    "subsurfaces",
+    "scale/transform",
+    "not opaque",
+    "commit failed",
+};
+
+static std::string format_msec(int64_t ns)
+{
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(2) << ns / 1000000.0 << "ms";
+
+    return out.str();
+}
+
+frame_stats_t::frame_stats_t(wf::output_t *output)
+{
+    this->output = output;
+}
+
+frame_stats_t::~frame_stats_t()
+{
+    if (gpu_timers_state <= 0)
+    {
+        return;
+    }
+
+    OpenGL::render_begin();
+    for (auto& frame : gpu_frames)
+    {
+        GL_CALL(glDeleteQueries(FRAME_PHASE_TOTAL, frame.queries));
+    }
+
+    OpenGL::render_end();
+}
+
+uint64_t frame_stats_t::get_heap_allocations()
+{
+#ifdef WF_ALLOC_STATS
+    return heap_allocations;
+#else
+    return 0;
+#endif
+}
+
+bool frame_stats_t::phase_uses_gpu(frame_phase_t phase)
+{
+    return phase >= FRAME_PHASE_RENDER && phase <= FRAME_PHASE_POST;
+}
+
+bool frame_stats_t::gpu_timers_supported()
+{
+    if (gpu_timers_state == 0)
+    {
+        auto extensions = (const char*)glGetString(GL_EXTENSIONS);
+        bool supported  = extensions &&
+            std::strstr(extensions, "GL_EXT_disjoint_timer_query");
+
+        gpu_timers_state = supported ? 1 : -1;
+        if (supported)
+        {
+            for (auto& frame : gpu_frames)
+            {
+                GL_CALL(glGenQueries(FRAME_PHASE_TOTAL, frame.queries));
+            }
+        }
+
+        LOGD("GPU frame timers on output ", output->to_string(), ": ",
+            supported ? "enabled" : "unsupported");
+    }
+
+    return gpu_timers_state > 0;
+}
+
+const frame_stats_t::frame_record_t& frame_stats_t::get_record(
+    int64_t frame) const
+{
+    return history[frame % HISTORY_SIZE];
+}
+
+frame_stats_t::frame_record_t& frame_stats_t::get_record(int64_t frame)
+{
+    return history[frame % HISTORY_SIZE];
+}
+
+frame_stats_t::gpu_frame_t& frame_stats_t::current_gpu_frame()
+{
+    return gpu_frames[frame_count % GPU_FRAMES_IN_FLIGHT];
+}
+
+void frame_stats_t::collect_gpu_results(gpu_frame_t& frame)
+{
+    if ((frame.frame < 0) || !frame.issued)
+    {
+        frame.frame = -1;
+
+        return;
+    }
+
+    GLint disjoint = 0;
+    GL_CALL(glGetIntegerv(GL_GPU_DISJOINT_EXT, &disjoint));
+
+    /* The record might have already been overwritten */
+    bool valid = !disjoint && (frame.frame + (int64_t)HISTORY_SIZE > frame_count);
+    for (int i = 0; i < FRAME_PHASE_TOTAL && valid; i++)
+    {
+        if (!(frame.issued & (1 << i)))
+        {
+            continue;
+        }
+
+        GLuint available = 0;
+        GL_CALL(glGetQueryObjectuiv(frame.queries[i],
+            GL_QUERY_RESULT_AVAILABLE, &available));
+        if (!available)
+        {
+            /* Never stall the pipeline just to read statistics */
+            continue;
+        }
+
+        GLuint elapsed = 0;
+        GL_CALL(glGetQueryObjectuiv(frame.queries[i], GL_QUERY_RESULT, &elapsed));
+        get_record(frame.frame).gpu_ns[i] = elapsed;
+    }
+
+    frame.issued = 0;
+    frame.frame  = -1;
+}
+
+void frame_stats_t::begin_frame()
+{
+    current = frame_record_t{};
+    std::fill(std::begin(current.gpu_ns), std::end(current.gpu_ns), -1);
+    current_phase = FRAME_PHASE_TOTAL;
+    frame_start   = stats_clock_t::now();
+    frame_start_allocations = get_heap_allocations();
+}
+
+void frame_stats_t::end_phase()
+{
+    if (current_phase == FRAME_PHASE_TOTAL)
+    {
+        return;
+    }
+
+    if (gpu_query_active)
+    {
+        GL_CALL(glEndQuery(GL_TIME_ELAPSED_EXT));
+        gpu_query_active = false;
+    }
+
+    auto elapsed = stats_clock_t::now() - phase_start;
+    current.cpu_ns[current_phase] +=
+        std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+    current_phase = FRAME_PHASE_TOTAL;
+}
+
+void frame_stats_t::begin_phase(frame_phase_t phase)
+{
+    end_phase();
+
+    current_phase = phase;
+    phase_start   = stats_clock_t::now();
+
+    if (!phase_uses_gpu(phase) || !gpu_timers_supported())
+    {
+        return;
+    }
+
+    auto& gpu_frame = current_gpu_frame();
+    if (gpu_frame.frame != frame_count)
+    {
+        /* First GPU phase in this frame, reuse the oldest query set */
+        collect_gpu_results(gpu_frame);
+        gpu_frame.frame = frame_count;
+    }
+
+    GL_CALL(glBeginQuery(GL_TIME_ELAPSED_EXT, gpu_frame.queries[phase]));
+    gpu_frame.issued |= (1 << phase);
+    gpu_query_active  = true;
+}
+
+void frame_stats_t::record_damage(int rects, int rendered_rects)
+{
+    current.damage_rects   = rects;
+    current.rendered_rects = rendered_rects;
+}
+
+void frame_stats_t::record_scanout(scanout_status_t status)
+{
+    scanout_counters[status]++;
+    if (status != last_scanout_status)
+    {
+        LOGD("Direct scanout on output ", output->to_string(), ": ",
+            scanout_status_names[status]);
+        last_scanout_status = status;
+    }
+}
+
+const std::array<uint64_t, SCANOUT_STATUS_TOTAL>& frame_stats_t::
+get_scanout_counters() const
+{
+    return scanout_counters;
+}
+
+void frame_stats_t::end_frame(frame_result_t result)
+{
+    end_phase();
+
+    current.result   = result;
+    current.total_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        stats_clock_t::now() - frame_start).count();
+    current.allocations = get_heap_allocations() - frame_start_allocations;
+
+    get_record(frame_count) = current;
+    ++frame_count;
+
+    if ((summary_interval.count() > 0) &&
+        (stats_clock_t::now() - last_summary_time >= summary_interval))
+    {
+        log_summary();
+    }
+}
+
+void frame_stats_t::set_summary_interval(int interval_sec)
+{
+    summary_interval  = std::chrono::seconds(std::max(interval_sec, 0));
+    last_summary      = frame_count;
+    last_summary_time = stats_clock_t::now();
+}
+
+void frame_stats_t::dump() const
+{
+    int64_t first = std::max<int64_t>(0, frame_count - HISTORY_SIZE);
+    int64_t results[FRAME_RESULT_TOTAL] = {0};
+
+    int64_t cpu_sum[FRAME_PHASE_TOTAL] = {0}, cpu_max[FRAME_PHASE_TOTAL] = {0};
+    int64_t gpu_sum[FRAME_PHASE_TOTAL] = {0}, gpu_max[FRAME_PHASE_TOTAL] = {0};
+    int64_t gpu_cnt[FRAME_PHASE_TOTAL] = {0};
+    int64_t total_max = 0;
+    int64_t alloc_sum = 0, alloc_max = 0;
+    int64_t rects_sum = 0, rects_max = 0;
+    int64_t rendered_sum = 0, rendered_max = 0;
+
+    for (int64_t i = first; i < frame_count; i++)
+    {
+        const auto& rec = get_record(i);
+        results[rec.result]++;
+        total_max  = std::max(total_max, rec.total_ns);
+        alloc_sum += rec.allocations;
+        alloc_max  = std::max(alloc_max, rec.allocations);
+        if (rec.result == FRAME_RESULT_RENDERED)
+        {
+            rects_sum    += rec.damage_rects;
+            rects_max     = std::max<int64_t>(rects_max, rec.damage_rects);
+            rendered_sum += rec.rendered_rects;
+            rendered_max  = std::max<int64_t>(rendered_max, rec.rendered_rects);
+        }
+        for (int p = 0; p < FRAME_PHASE_TOTAL; p++)
+        {
+            cpu_sum[p] += rec.cpu_ns[p];
+            cpu_max[p]  = std::max(cpu_max[p], rec.cpu_ns[p]);
+            if (rec.gpu_ns[p] >= 0)
+            {
+                gpu_sum[p] += rec.gpu_ns[p];
+                gpu_max[p]  = std::max(gpu_max[p], rec.gpu_ns[p]);
+                gpu_cnt[p]++;
+            }
+        }
+    }
+
+    int64_t count = frame_count - first;
+    LOGI("Frame statistics for output ", output->to_string(), ": last ", count,
+        " frames (", results[FRAME_RESULT_RENDERED], " rendered, ",
+        results[FRAME_RESULT_SCANOUT], " scanned out, ",
+        results[FRAME_RESULT_SKIPPED], " skipped), max frame time ",
+        format_msec(total_max));
+
+    if (count == 0)
+    {
+        return;
+    }
+
+    for (int p = 0; p < FRAME_PHASE_TOTAL; p++)
+    {
+        std::string gpu = "n/a";
+        if (gpu_cnt[p] > 0)
+        {
+            gpu = "avg " + format_msec(gpu_sum[p] / gpu_cnt[p]) +
+                " max " + format_msec(gpu_max[p]);
+        }
+
+        LOGI("  ", phase_names[p],
+            ": cpu avg ", format_msec(cpu_sum[p] / count),
+            " max ", format_msec(cpu_max[p]), ", gpu ", gpu);
+    }
+
+    int64_t rendered = results[FRAME_RESULT_RENDERED];
+    if (rendered > 0)
+    {
+        LOGI("  damage rectangles: avg ", rects_sum / rendered, " max ", rects_max,
+            ", after simplification avg ", rendered_sum / rendered,
+            " max ", rendered_max);
+    }
+
+    std::string scanout;
+    for (int i = 0; i < SCANOUT_STATUS_TOTAL; i++)
+    {
+        if (scanout_counters[i] > 0)
+        {
+            scanout += (scanout.empty() ? "" : ", ") +
+                std::string(scanout_status_names[i]) + " " +
+                std::to_string(scanout_counters[i]);
+        }
+    }
+
+    if (!scanout.empty())
+    {
+        LOGI("  direct scanout attempts since start: ", scanout);
+    }
+
+    /* The counter is 0 if allocations are not being counted */
+    if (get_heap_allocations() > 0)
+    {
+        LOGI("  heap allocations per frame: avg ", alloc_sum / count,
+            " max ", alloc_max);
+    }
+}
+
+void frame_stats_t::log_summary()
+{
+    int64_t first = std::max(last_summary, frame_count - (int64_t)HISTORY_SIZE);
+    int64_t count = frame_count - first;
+    last_summary = frame_count;
+    last_summary_time = stats_clock_t::now();
+
+    if (count == 0)
+    {
+        return;
+    }
+
+    int64_t total_sum = 0, total_max = 0;
+    int64_t phase_sum[FRAME_PHASE_TOTAL] = {0};
+    for (int64_t i = first; i < frame_count; i++)
+    {
+        const auto& rec = get_record(i);
+        total_sum += rec.total_ns;
+        total_max  = std::max(total_max, rec.total_ns);
+        for (int p = 0; p < FRAME_PHASE_TOTAL; p++)
+        {
+            phase_sum[p] += rec.cpu_ns[p];
+        }
+    }
+
+    int slowest = std::max_element(phase_sum, phase_sum + FRAME_PHASE_TOTAL) -
+        phase_sum;
+    LOGI("Output ", output->to_string(), ": ", count, " frames, cpu avg ",
+        format_msec(total_sum / count), " max ", format_msec(total_max),
+        ", most time in ", phase_names[slowest]);
+}
+}
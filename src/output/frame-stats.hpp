@@ -0,0 +1,210 @@
+#ifndef WF_FRAME_STATS_HPP
+#define WF_FRAME_STATS_HPP
+
+#include <array>
+#include <chrono>
+#include <wayfire/opengl.hpp>
+#include <wayfire/nonstd/noncopyable.hpp>
+
+namespace wf
+{
+class output_t;
+
+/**
+ * The phases of an output repaint, in the order in which they happen in
+ * render_manager's paint().
+ */
+enum frame_phase_t
+{
+    /* PRE and DAMAGE effect hooks */
+    FRAME_PHASE_EFFECTS = 0,
+    /* Direct scanout attempt */
+    FRAME_PHASE_SCANOUT = 1,
+    /* Attaching the renderer to the output and collecting damage */
+    FRAME_PHASE_ATTACH  = 2,
+    /* render_output(), i.e the default renderer or a plugin render hook */
+    FRAME_PHASE_RENDER  = 3,
+    /* OVERLAY effect hooks */
+    FRAME_PHASE_OVERLAY = 4,
+    /* Software cursors */
+    FRAME_PHASE_CURSORS = 5,
+    /* Postprocessing hooks */
+    FRAME_PHASE_POST    = 6,
+    /* Committing the output */
+    FRAME_PHASE_SWAP    = 7,
+    /* Invalid phase, used internally */
+    FRAME_PHASE_TOTAL   = 8,
+};
+
+/**
+ * How a repaint cycle ended.
+ */
+enum frame_result_t
+{
+    /* The frame was rendered and committed */
+    FRAME_RESULT_RENDERED = 0,
+    /* A view was scanned out directly */
+    FRAME_RESULT_SCANOUT  = 1,
+    /* Nothing needed repainting, or the output could not be attached */
+    FRAME_RESULT_SKIPPED  = 2,
+    /* Invalid result, used internally */
+    FRAME_RESULT_TOTAL    = 3,
+};
+
+/**
+ * The outcome of an attempt to scan out a view directly.
+ */
+enum scanout_status_t
+{
+    /* A view was scanned out */
+    SCANOUT_SUCCESS                = 0,
+    /* Drag and drop, inhibited output or render hook */
+    SCANOUT_FAIL_DISABLED          = 1,
+    /* Overlay or postprocessing effects are active */
+    SCANOUT_FAIL_EFFECTS           = 2,
+    /* No view covers exactly the whole output */
+    SCANOUT_FAIL_NO_CANDIDATE      = 3,
+    /* The candidate view has a transformer */
+    SCANOUT_FAIL_TRANSFORMER       = 4,
+    /* The candidate view has subsurfaces or child views */
+    SCANOUT_FAIL_SUBSURFACES       = 5,
+    /* The buffer scale or transform do not match the output */
+    SCANOUT_FAIL_SCALE_TRANSFORM   = 6,
+    /* The candidate view is not fully opaque */
+    SCANOUT_FAIL_NOT_OPAQUE        = 7,
+    /* The backend refused to commit the buffer */
+    SCANOUT_FAIL_COMMIT            = 8,
+    /* Invalid status, used internally */
+    SCANOUT_STATUS_TOTAL           = 9,
+};
+
+/**
+ * frame_stats_t keeps a history of the time spent in each phase of the last
+ * repaint cycles of an output.
+ *
+ * CPU time is always measured. GPU time is measured for the phases which
+ * issue GL commands, if the driver supports GL_EXT_disjoint_timer_query.
+ * GPU results become available a few frames later, so they are filled into
+ * the history asynchronously.
+ */
+class frame_stats_t : public noncopyable_t
+{
+  public:
+    frame_stats_t(wf::output_t *output);
+    ~frame_stats_t();
+
+    /** Start recording a new repaint cycle. */
+    void begin_frame();
+
+    /**
+     * Finish the current phase (if any) and start the given one.
+     * Phases which issue GL commands may only be started while the output is
+     * attached for rendering.
+     */
+    void begin_phase(frame_phase_t phase);
+
+    /**
+     * Record the complexity of the damage of the current frame.
+     *
+     * @param rects The number of rectangles in the accumulated damage.
+     * @param rendered_rects The number of rectangles after simplification.
+     */
+    void record_damage(int rects, int rendered_rects);
+
+    /**
+     * Record the outcome of a direct scanout attempt.
+     * Changes of the outcome are logged at debug level.
+     */
+    void record_scanout(scanout_status_t status);
+
+    /**
+     * Get the number of scanout attempts with each outcome since the output
+     * was created, indexed by scanout_status_t.
+     */
+    const std::array<uint64_t, SCANOUT_STATUS_TOTAL>& get_scanout_counters() const;
+
+    /** Finish the current phase and store the frame in the history. */
+    void end_frame(frame_result_t result);
+
+    /** Log a detailed per-phase summary of the recorded history. */
+    void dump() const;
+
+    /**
+     * Set how often a one-line summary of the recent frames is logged.
+     * The summary is logged at the end of the first frame after the interval
+     * has passed, so idle outputs do not log anything.
+     *
+     * @param interval_sec The interval in seconds, or 0 to disable.
+     */
+    void set_summary_interval(int interval_sec);
+
+    /**
+     * Get the number of heap allocations done with operator new on the
+     * compositor thread so far. Always 0 unless wayfire is built with the
+     * alloc_stats option.
+     */
+    static uint64_t get_heap_allocations();
+
+  private:
+    using stats_clock_t = std::chrono::steady_clock;
+    static constexpr size_t HISTORY_SIZE = 128;
+    static constexpr size_t GPU_FRAMES_IN_FLIGHT = 4;
+
+    struct frame_record_t
+    {
+        frame_result_t result = FRAME_RESULT_TOTAL;
+        int64_t cpu_ns[FRAME_PHASE_TOTAL] = {0};
+        /* -1 if no GPU time was measured for the phase */
+        int64_t gpu_ns[FRAME_PHASE_TOTAL] = {0};
+        int64_t total_ns = 0;
+        int64_t allocations = 0;
+        int damage_rects    = 0;
+        int rendered_rects  = 0;
+    };
+
+    struct gpu_frame_t
+    {
+        GLuint queries[FRAME_PHASE_TOTAL];
+        /* Bitmask of phases with an issued query */
+        uint32_t issued = 0;
+        /* Index of the record in the history, or -1 */
+        int64_t frame = -1;
+    };
+
+    wf::output_t *output;
+
+    std::array<frame_record_t, HISTORY_SIZE> history;
+    /* Total number of recorded frames */
+    int64_t frame_count = 0;
+    /* frame_count and time at the last summary */
+    int64_t last_summary = 0;
+    stats_clock_t::time_point last_summary_time;
+    std::chrono::seconds summary_interval{0};
+
+    frame_record_t current;
+    frame_phase_t current_phase = FRAME_PHASE_TOTAL;
+    stats_clock_t::time_point frame_start, phase_start;
+    uint64_t frame_start_allocations = 0;
+
+    std::array<uint64_t, SCANOUT_STATUS_TOTAL> scanout_counters = {0};
+    scanout_status_t last_scanout_status = SCANOUT_STATUS_TOTAL;
+
+    /* GPU timer queries. gpu_timers_state is 0 before the first check,
+     * 1 if supported, -1 if unsupported */
+    int gpu_timers_state = 0;
+    std::array<gpu_frame_t, GPU_FRAMES_IN_FLIGHT> gpu_frames;
+    bool gpu_query_active = false;
+
+    static bool phase_uses_gpu(frame_phase_t phase);
+    bool gpu_timers_supported();
+    gpu_frame_t& current_gpu_frame();
+    void collect_gpu_results(gpu_frame_t& frame);
+    void end_phase();
+    void log_summary();
+
+    const frame_record_t& get_record(int64_t frame) const;
+    frame_record_t& get_record(int64_t frame);
+};
+}
+
+#endif /* end of include guard: WF_FRAME_STATS_HPP */
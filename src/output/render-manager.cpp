@@ -2,13 +2,20 @@
 #include "wayfire/signal-definitions.hpp"
 #include "wayfire/workspace-stream.hpp"
 #include "wayfire/output.hpp"
+#include "wayfire/output-layout.hpp"
 #include "../core/core-impl.hpp"
 #include "wayfire/util.hpp"
 #include "wayfire/workspace-manager.hpp"
 #include "../core/seat/seat.hpp"
 #include "../core/opengl-priv.hpp"
 #include "../main.hpp"
+#include "frame-stats.hpp"
 #include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <deque>
+#include <unordered_map>
 #include <wayfire/nonstd/reverse.hpp>
 #include <wayfire/nonstd/safe-list.hpp>
 #include <wayfire/util/log.hpp>
@@ -70,6 +77,75 @@ struct output_damage_t
 
     wf::region_t acc_damage;
 
+    static int64_t get_area(const wf::region_t& region)
+    {
+        int64_t area = 0;
+        for (const auto& box : region)
+        {
+            area += int64_t(box.x2 - box.x1) * (box.y2 - box.y1);
+        }
+
+        return area;
+    }
+
+    /**
+     * Bound the number of rectangles in frame_damage. Each rectangle costs a
+     * draw call for every surface it intersects, so with many small damaged
+     * rectangles it is cheaper to repaint some undamaged pixels as well.
+     *
+     * If the bounding box of the damage does not waste too much area, the
+     * damage is replaced with it. Otherwise, the bounding box of the damage is
+     * split into a grid of about max_rects cells, and the damage inside each
+     * cell is replaced with its bounding box.
+     *
+     * Needs to be called after accumulate_damage().
+     *
+     * @param max_rects The maximal number of rectangles, or 0 to disable.
+     * @param max_waste The maximal fraction of the bounding box which may be
+     *   undamaged.
+     */
+    void simplify_damage(int max_rects, double max_waste)
+    {
+        int rects = pixman_region32_n_rects(frame_damage.to_pixman());
+        if ((max_rects <= 0) || (rects <= max_rects))
+        {
+            return;
+        }
+
+        auto extents = wlr_box_from_pixman_box(frame_damage.get_extents());
+        int64_t extents_area = int64_t(extents.width) * extents.height;
+        if (extents_area - get_area(frame_damage) <= max_waste * extents_area)
+        {
+            frame_damage = extents;
+
+            return;
+        }
+
+        /* The cells are unions of whole rectangles in the result, so pixman
+         * may split their union into somewhat more rectangles than cells */
+        int cells = std::max(1, (int)std::sqrt(max_rects));
+        wf::region_t merged;
+        for (int i = 0; i < cells; i++)
+        {
+            for (int j = 0; j < cells; j++)
+            {
+                int x1 = extents.x + extents.width * i / cells;
+                int x2 = extents.x + extents.width * (i + 1) / cells;
+                int y1 = extents.y + extents.height * j / cells;
+                int y2 = extents.y + extents.height * (j + 1) / cells;
+
+                wf::geometry_t cell_box = {x1, y1, x2 - x1, y2 - y1};
+                auto cell = frame_damage & cell_box;
+                if (!cell.empty())
+                {
+                    merged |= wlr_box_from_pixman_box(cell.get_extents());
+                }
+            }
+        }
+
+        frame_damage = std::move(merged);
+    }
+
     /**
      * Make the output current. This sets its EGL context as current, checks
      * whether there is any damage and makes sure frame_damage contains all the
@@ -145,6 +221,7 @@ struct output_damage_t
         wlr_output_set_damage(output,
             const_cast<wf::region_t&>(swap_damage).to_pixman());
         wlr_output_commit(output);
+        push_damage_history();
         frame_damage.clear();
     }
 
@@ -185,14 +262,69 @@ struct output_damage_t
     }
 
     /**
-     * Returns the scheduled damage for the given workspace, in output-local
-     * coordinates.
+     * The damage of the last frames, in logical coordinates relative to the
+     * top-left workspace, so that it stays valid when the current workspace
+     * changes. The last element is the damage of frame (frame_seq - 1).
      */
-    wf::region_t get_ws_damage(wf::point_t ws)
+    std::deque<wf::region_t> damage_history;
+    static constexpr size_t DAMAGE_HISTORY_SIZE = 16;
+    /* The sequence number of the frame which is currently being scheduled */
+    uint64_t frame_seq = 1;
+
+    wf::point_t get_grid_offset() const
     {
+        auto current = wo->workspace->get_current_workspace();
+        auto size    = wo->get_screen_size();
+
+        return {current.x * size.width, current.y * size.height};
+    }
+
+    /**
+     * Returns the damage for the given workspace since the given frame, in
+     * output-local coordinates.
+     *
+     * @param since The frame_seq when the workspace was last repainted, or 0
+     *   to get only the damage scheduled for the current frame. If the
+     *   damage of that frame is no longer available, the whole workspace is
+     *   returned.
+     */
+    wf::region_t get_ws_damage(wf::point_t ws, uint64_t since = 0)
+    {
+        auto box = get_ws_box(ws);
         auto scaled = frame_damage * (1.0 / wo->handle->scale);
+        if (since == 0)
+        {
+            return scaled & box;
+        }
+
+        if (since + damage_history.size() < frame_seq)
+        {
+            return box;
+        }
 
-        return scaled & get_ws_box(ws);
+        auto offset = get_grid_offset();
+        for (size_t i = damage_history.size() - (frame_seq - since);
+             i < damage_history.size(); i++)
+        {
+            scaled |= damage_history[i] + -offset;
+        }
+
+        return scaled & box;
+    }
+
+    /**
+     * Move the damage of the current frame to the history.
+     */
+    void push_damage_history()
+    {
+        auto damage = frame_damage * (1.0 / wo->handle->scale);
+        damage_history.push_back(damage + get_grid_offset());
+        if (damage_history.size() > DAMAGE_HISTORY_SIZE)
+        {
+            damage_history.pop_front();
+        }
+
+        ++frame_seq;
     }
 
     /**
@@ -299,33 +431,97 @@ struct postprocessing_manager_t
         this->output_fb = output_fb;
     }
 
-    void allocate(int width, int height)
+    /**
+     * Make sure the buffers used by the post effects have the given size.
+     *
+     * @return Whether any buffer was (re)allocated, i.e. lost its contents.
+     */
+    bool allocate(int width, int height)
     {
         if (post_effects.size() == 0)
         {
-            return;
+            return false;
         }
 
         output_width  = width;
         output_height = height;
 
+        /* The last hook renders directly to the output */
+        size_t used_buffers = std::min<size_t>(post_effects.size(), 3);
+        bool reallocated    = false;
+
         OpenGL::render_begin();
-        post_buffers[default_out_buffer].allocate(width, height);
+        for (size_t i = 0; i < used_buffers; i++)
+        {
+            reallocated |= post_buffers[i].allocate(width, height);
+        }
+
         OpenGL::render_end();
+
+        return reallocated;
     }
 
-    void add_post(post_hook_t *hook)
+    /* Sampling radius of each hook, -1 if it processes the whole output */
+    std::unordered_map<post_hook_t*, int> damage_radius;
+
+    void add_post(post_hook_t *hook, int radius)
     {
         post_effects.push_back(hook);
+        damage_radius[hook] = radius;
         output->render->damage_whole_idle();
     }
 
     void rem_post(post_hook_t *hook)
     {
         post_effects.remove_all(hook);
+        damage_radius.erase(hook);
         output->render->damage_whole_idle();
     }
 
+    /**
+     * @return By how much the damage has to be expanded so that every post
+     *   hook can process only the damaged area, or -1 if a hook needs to
+     *   process the whole output.
+     */
+    int get_damage_radius() const
+    {
+        int total = 0;
+        for (auto& hook : damage_radius)
+        {
+            if (hook.second < 0)
+            {
+                return -1;
+            }
+
+            total += hook.second;
+        }
+
+        return total;
+    }
+
+    /* The damage of the current frame in post buffer coordinates */
+    wf::region_t post_damage;
+
+    /**
+     * Set the region the post hooks have to update in this frame.
+     *
+     * @param damage The region, in the coordinate system of the swap damage.
+     */
+    void set_post_damage(const wf::region_t& damage)
+    {
+        /* Same conversion as framebuffer_t::framebuffer_box_from_geometry_box,
+         * after scaling, which has already been applied to the damage */
+        auto fb = get_target_framebuffer();
+        int width, height;
+        wlr_output_transformed_resolution(output->handle, &width, &height);
+
+        wl_output_transform transform =
+            wlr_output_transform_invert((wl_output_transform)fb.wl_transform);
+        post_damage = damage;
+        wlr_region_transform(post_damage.to_pixman(), post_damage.to_pixman(),
+            transform, width, height);
+    }
+
     /* Run all postprocessing effects, rendering to alternating buffers and
      * finally to the screen.
      *
@@ -502,6 +698,147 @@ class depth_buffer_manager_t : public noncopyable_t
     std::vector<depth_buffer_t> buffers;
 };
 
+/**
+ * Learns how long it takes to repaint the output, and computes how long to
+ * wait after a frame event before starting the repaint, so that the repaint
+ * finishes as late as possible but still before the next vblank.
+ *
+ * Each commit made after a delayed repaint is checked against the presentation
+ * feedback to see whether the deadline was actually met. Missed deadlines
+ * increase the safety margin, while long series of hits slowly decrease it.
+ */
+struct repaint_delay_controller_t
+{
+    static constexpr int HISTORY_SIZE = 60;
+    static constexpr int64_t MIN_MARGIN_NSEC  = 1000000;
+    static constexpr int64_t MARGIN_STEP_NSEC = 500000;
+    static constexpr int HITS_BEFORE_DECREASE = 120;
+
+    /* Durations of the last rendered frames */
+    std::array<int64_t, HISTORY_SIZE> render_times = {0};
+    int next_render_time = 0;
+    int64_t recorded_frames = 0;
+
+    int64_t margin_nsec    = MIN_MARGIN_NSEC;
+    int64_t predicted_nsec = 0;
+    int consecutive_hits   = 0;
+
+    /* Deadline of the last commit, in the presentation clock. 0 if none. */
+    int64_t pending_deadline = 0;
+    int64_t last_frame_event = 0;
+
+    int64_t deadlines_hit    = 0;
+    int64_t deadlines_missed = 0;
+
+    static int64_t timespec_to_nsec(const timespec& ts)
+    {
+        return ts.tv_sec * 1000000000ll + ts.tv_nsec;
+    }
+
+    static int64_t get_presentation_time()
+    {
+        timespec now;
+        clock_gettime(wlr_backend_get_presentation_clock(
+            wf::get_core_impl().backend), &now);
+
+        return timespec_to_nsec(now);
+    }
+
+    void record_render_time(int64_t nsec)
+    {
+        render_times[next_render_time] = nsec;
+        next_render_time = (next_render_time + 1) % HISTORY_SIZE;
+        ++recorded_frames;
+    }
+
+    /**
+     * Called on each frame event.
+     *
+     * @return The time to wait before repainting, in milliseconds.
+     */
+    int64_t compute_delay_msec(int64_t refresh_nsec)
+    {
+        last_frame_event = get_presentation_time();
+        if (recorded_frames == 0)
+        {
+            /* Nothing learned yet, render right away */
+            return 0;
+        }
+
+        predicted_nsec = predict_render_nsec();
+
+        return std::max<int64_t>(0, (refresh_nsec - predicted_nsec) / 1000000);
+    }
+
+    /**
+     * @return How long a repaint is expected to take, including the safety
+     *   margin, or 0 if no frames have been recorded yet.
+     */
+    int64_t predict_render_nsec() const
+    {
+        if (recorded_frames == 0)
+        {
+            return 0;
+        }
+
+        return *std::max_element(render_times.begin(), render_times.end()) +
+               margin_nsec;
+    }
+
+    /** Called after the output has been committed */
+    void frame_committed(int64_t refresh_nsec)
+    {
+        if ((refresh_nsec <= 0) || (last_frame_event == 0))
+        {
+            return;
+        }
+
+        pending_deadline = last_frame_event + refresh_nsec;
+        last_frame_event = 0;
+    }
+
+    void handle_present(const wlr_output_event_present *ev)
+    {
+        if (!pending_deadline || !ev->when)
+        {
+            return;
+        }
+
+        /* Presented up to half a refresh cycle later than the vblank following
+         * the frame event counts as a hit, to account for timestamp jitter */
+        int64_t presented = timespec_to_nsec(*ev->when);
+        if (presented <= pending_deadline + ev->refresh / 2)
+        {
+            ++deadlines_hit;
+            if (++consecutive_hits >= HITS_BEFORE_DECREASE)
+            {
+                consecutive_hits = 0;
+                margin_nsec = std::max(MIN_MARGIN_NSEC,
+                    margin_nsec - MARGIN_STEP_NSEC / 5);
+            }
+        } else
+        {
+            ++deadlines_missed;
+            consecutive_hits = 0;
+            margin_nsec = std::min<int64_t>(margin_nsec + MARGIN_STEP_NSEC,
+                std::max(ev->refresh / 2, 0));
+        }
+
+        pending_deadline = 0;
+    }
+
+    void dump(wf::output_t *output) const
+    {
+        int64_t total = deadlines_hit + deadlines_missed;
+        double rate   = total ? 100.0 * deadlines_hit / total : 100.0;
+
+        LOGI("Adaptive repaint delay on output ", output->to_string(),
+            ": predicted render time ", predicted_nsec / 1000, "us (margin ",
+            margin_nsec / 1000, "us), deadlines met ", deadlines_hit, "/", total,
+            " (", rate, "%)");
+    }
+};
+
 class wf::render_manager::impl
 {
   public:
@@ -516,9 +853,26 @@ class wf::render_manager::impl
     std::unique_ptr<effect_hook_manager_t> effects;
     std::unique_ptr<postprocessing_manager_t> postprocessing;
     std::unique_ptr<depth_buffer_manager_t> depth_buffer_manager;
+    std::unique_ptr<frame_stats_t> frame_stats;
 
     wf::option_wrapper_t<wf::color_t> background_color_opt;
     wf::option_wrapper_t<int> max_render_time_opt;
+    wf::option_wrapper_t<bool> adaptive_render_time_opt;
+    wf::option_wrapper_t<int> frame_stats_interval_opt;
+    wf::option_wrapper_t<int> occluded_frame_interval_opt;
+    wf::option_wrapper_t<int> damage_max_rects_opt{"core/damage_max_rects"};
+    wf::option_wrapper_t<double> damage_max_waste_opt{"core/damage_max_waste"};
+    repaint_delay_controller_t repaint_delay;
+
+    wf::signal_connection_t on_dump_stats = [=] (wf::signal_data_t*)
+    {
+        frame_stats->dump();
+        dump_stream_stats();
+        if (adaptive_render_time_opt)
+        {
+            repaint_delay.dump(output);
+        }
+    };
 
     impl(output_t *o) :
         output(o)
@@ -527,23 +881,46 @@ class wf::render_manager::impl
         effects = std::make_unique<effect_hook_manager_t>();
         postprocessing = std::make_unique<postprocessing_manager_t>(o);
         depth_buffer_manager = std::make_unique<depth_buffer_manager_t>();
+        frame_stats = std::make_unique<frame_stats_t>(o);
 
         on_present.set_callback([&] (void *data)
         {
             auto ev = static_cast<wlr_output_event_present*>(data);
             this->refresh_nsec = ev->refresh;
+            repaint_delay.handle_present(ev);
         });
         on_present.connect(&output->handle->events.present);
 
         max_render_time_opt.load_option("core/max_render_time");
+        adaptive_render_time_opt.load_option("core/adaptive_render_time");
+        occluded_frame_interval_opt.load_option("core/occluded_frame_interval");
         on_frame.set_callback([&] (void*)
         {
+            if (is_suspended())
+            {
+                /* Neither repaint nor let clients render for a black screen */
+                return;
+            }
+
             /*
              * Leave a bit of time for clients to render, see
              * https://github.com/swaywm/sway/pull/4588
              */
-            int64_t total = this->refresh_nsec / 1000000 - max_render_time_opt;
-            if ((total <= 0) || (max_render_time_opt <= 0) || this->renderer)
+            frame_event_nsec = repaint_delay.get_presentation_time();
+            int64_t total;
+            if (adaptive_render_time_opt)
+            {
+                total = repaint_delay.compute_delay_msec(this->refresh_nsec);
+            } else
+            {
+                total = this->refresh_nsec / 1000000 - max_render_time_opt;
+                if (max_render_time_opt <= 0)
+                {
+                    total = 0;
+                }
+            }
+
+            if ((total <= 0) || this->renderer)
             {
                 total = 0;
             }
@@ -552,6 +929,7 @@ class wf::render_manager::impl
             if (total < 1)
             {
                 paint();
+                run_idle_work();
             } else
             {
                 output->handle->frame_pending = true;
@@ -559,6 +937,7 @@ class wf::render_manager::impl
                 {
                     output->handle->frame_pending = false;
                     paint();
+                    run_idle_work();
                 });
             }
 
@@ -566,7 +945,8 @@ class wf::render_manager::impl
         });
         on_frame.connect(&output_damage->damage_manager->events.frame);
 
-        init_default_streams();
+        default_stream.buffer.fb  = 0;
+        default_stream.buffer.tex = 0;
 
         background_color_opt.load_option("core/background_color");
         background_color_opt.set_callback([=] ()
@@ -574,28 +954,24 @@ class wf::render_manager::impl
             output_damage->damage_whole_idle();
         });
 
+        frame_stats_interval_opt.load_option("core/frame_stats_interval");
+        frame_stats->set_summary_interval(frame_stats_interval_opt);
+        frame_stats_interval_opt.set_callback([=] ()
+        {
+            frame_stats->set_summary_interval(frame_stats_interval_opt);
+        });
+        wf::get_core().connect_signal("dump-stats", &on_dump_stats);
+        stream_release_timeout_opt.set_callback([=] ()
+        {
+            release_idle_streams();
+        });
+
         output_damage->schedule_repaint();
     }
 
-    /* A stream for each workspace */
-    std::vector<std::vector<workspace_stream_t>> default_streams;
-    /* The stream pointing to the current workspace */
-    nonstd::observer_ptr<workspace_stream_t> current_ws_stream;
-    void init_default_streams()
-    {
-        auto wsize = output->workspace->get_workspace_grid_size();
-        default_streams.resize(wsize.width);
-        for (int i = 0; i < wsize.width; i++)
-        {
-            default_streams[i].resize(wsize.height);
-            for (int j = 0; j < wsize.height; j++)
-            {
-                default_streams[i][j].buffer.fb  = 0;
-                default_streams[i][j].buffer.tex = 0;
-                default_streams[i][j].ws = {i, j};
-            }
-        }
-    }
+    /* The stream of the default renderer. It renders directly to the output,
+     * and is moved to the current workspace when the workspace changes. */
+    workspace_stream_t default_stream;
 
     render_hook_t renderer;
     void set_renderer(render_hook_t rh)
@@ -604,6 +980,17 @@ class wf::render_manager::impl
         output_damage->damage_whole_idle();
     }
 
+    /* The region changed by the render hook in the current frame, in
+     * output-local coordinates. Only valid if renderer_damage_reported. */
+    wf::region_t renderer_damage;
+    bool renderer_damage_reported = false;
+
+    void report_renderer_damage(const wf::region_t& damage)
+    {
+        renderer_damage |= damage;
+        renderer_damage_reported = true;
+    }
+
     int constant_redraw_counter = 0;
     void set_redraw_always(bool always)
     {
@@ -625,9 +1012,18 @@ class wf::render_manager::impl
     }
 
     int output_inhibit_counter = 0;
+    /* Whether the black frame for the inhibited output has been committed */
+    bool inhibited_frame_committed = false;
+
     void add_inhibit(bool add)
     {
         output_inhibit_counter += add ? 1 : -1;
+        if (add && (output_inhibit_counter == 1))
+        {
+            inhibited_frame_committed = false;
+            output_damage->schedule_repaint();
+        }
+
         if (output_inhibit_counter == 0)
         {
             output_damage->damage_whole_idle();
@@ -647,8 +1043,37 @@ class wf::render_manager::impl
     {
         OpenGL::bind_output(output, fb);
 
-        /* Make sure the default buffer has enough size */
-        postprocessing->allocate(output->handle->width, output->handle->height);
+        /* Make sure the post buffers have enough size */
+        post_buffers_reallocated = postprocessing->allocate(
+            output->handle->width, output->handle->height);
+    }
+
+    bool post_buffers_reallocated = false;
+
+    /**
+     * Post hooks read their source around the pixels they write, so changes
+     * spread by the sum of their sampling radii. Expand the frame damage
+     * accordingly, so that each hook only has to process the damaged area.
+     * If a hook processes the whole output, or the post buffers lost their
+     * contents, the whole output is damaged instead.
+     */
+    void expand_damage_for_post_effects()
+    {
+        if (postprocessing->post_effects.size() == 0)
+        {
+            return;
+        }
+
+        auto& damage = output_damage->frame_damage;
+        int radius   = postprocessing->get_damage_radius();
+        if ((radius < 0) || post_buffers_reallocated)
+        {
+            damage |= output_damage->get_wlr_damage_box();
+        } else if (radius > 0)
+        {
+            damage.expand_edges(radius);
+            damage &= output_damage->get_wlr_damage_box();
+        }
     }
 
     /**
@@ -670,62 +1095,86 @@ class wf::render_manager::impl
         }
 
         auto cws = output->workspace->get_current_workspace();
-        auto target_stream = &default_streams[cws.x][cws.y];
-        if (current_ws_stream.get() != target_stream)
+        if (!default_stream.running || (default_stream.ws != cws))
         {
-            if (current_ws_stream)
+            if (default_stream.running)
             {
-                workspace_stream_stop(*current_ws_stream);
+                workspace_stream_stop(default_stream);
             }
 
-            current_ws_stream = nonstd::make_observer(target_stream);
-            workspace_stream_start(*current_ws_stream);
+            default_stream.ws = cws;
+            default_stream.last_frame = 0;
+            workspace_stream_start(default_stream);
         } else
         {
-            workspace_stream_update(*current_ws_stream);
+            workspace_stream_update(default_stream);
         }
     }
 
     wayfire_view last_scanout;
+
+    /**
+     * Find the topmost view on the current workspace which shows something on
+     * the output. Views which are hidden or outside of the output do not
+     * prevent a view below them from being scanned out.
+     */
+    wayfire_view find_scanout_candidate()
+    {
+        auto views = output->workspace->get_views_on_workspace(
+            output->workspace->get_current_workspace(), wf::VISIBLE_LAYERS);
+
+        auto output_geometry = output->get_relative_geometry();
+        for (auto& view : views)
+        {
+            if (view->is_visible() &&
+                (view->get_bounding_box() & output_geometry))
+            {
+                return view;
+            }
+        }
+
+        return nullptr;
+    }
+
     /**
      * Try to directly scanout a view
      */
-    bool do_direct_scanout()
+    scanout_status_t try_direct_scanout()
     {
         const bool can_scanout =
             !wf::get_core_impl().seat->drag_active &&
             !output_inhibit_counter &&
-            !renderer &&
-            effects->can_scanout() &&
-            postprocessing->can_scanout();
+            !renderer;
 
         if (!can_scanout)
         {
-            return false;
+            return SCANOUT_FAIL_DISABLED;
         }
 
-        auto views = output->workspace->get_views_on_workspace(
-            output->workspace->get_current_workspace(), wf::VISIBLE_LAYERS);
-
-        if (views.empty())
+        if (!effects->can_scanout() || !postprocessing->can_scanout())
         {
-            return false;
+            return SCANOUT_FAIL_EFFECTS;
         }
 
-        auto candidate = views.front();
+        auto candidate = find_scanout_candidate();
 
         // The candidate must cover the whole output
-        if (candidate->get_output_geometry() != output->get_relative_geometry())
+        if (!candidate ||
+            (candidate->get_output_geometry() != output->get_relative_geometry()))
         {
-            return false;
+            return SCANOUT_FAIL_NO_CANDIDATE;
+        }
+
+        if (candidate->has_transformer())
+        {
+            return SCANOUT_FAIL_TRANSFORMER;
         }
 
-        // The view must have only a single surface and no transformers
-        if (candidate->has_transformer() ||
-            !candidate->priv->surface_children_above.empty() ||
+        // The view must have only a single surface
+        if (!candidate->priv->surface_children_above.empty() ||
             !candidate->children.empty())
         {
-            return false;
+            return SCANOUT_FAIL_SUBSURFACES;
         }
 
         // Must have a wlr surface with the correct scale and transform
@@ -734,7 +1183,7 @@ class wf::render_manager::impl
             (surface->current.scale != output->handle->scale) ||
             (surface->current.transform != output->handle->transform))
         {
-            return false;
+            return SCANOUT_FAIL_SCALE_TRANSFORM;
         }
 
         // Finally, the opaque region must be the full surface.
@@ -742,7 +1191,7 @@ class wf::render_manager::impl
         non_opaque ^= candidate->get_opaque_region(wf::point_t{0, 0});
         if (!non_opaque.empty())
         {
-            return false;
+            return SCANOUT_FAIL_NOT_OPAQUE;
         }
 
         wlr_presentation_surface_sampled_on_output(
@@ -758,14 +1207,26 @@ class wf::render_manager::impl
                     candidate->get_title(), ",", candidate->get_app_id());
             }
 
-            return true;
+            return SCANOUT_SUCCESS;
         } else
         {
             LOGD("Failed to scan out view ", candidate->get_title());
-            return false;
+            return SCANOUT_FAIL_COMMIT;
         }
     }
 
+    /**
+     * Try to directly scanout a view, and record the outcome in the frame
+     * statistics.
+     */
+    bool do_direct_scanout()
+    {
+        auto status = try_direct_scanout();
+        frame_stats->record_scanout(status);
+
+        return status == SCANOUT_SUCCESS;
+    }
+
     /**
      * Return the swap damage if called from overlay or postprocessing
      * effect callbacks or empty region otherwise.
@@ -783,9 +1244,23 @@ class wf::render_manager::impl
     {
         if (renderer)
         {
+            renderer_damage.clear();
+            renderer_damage_reported = false;
             renderer(postprocessing->get_target_framebuffer());
-            /* TODO: let custom renderers specify what they want to repaint... */
-            swap_damage |= output_damage->get_wlr_damage_box();
+
+            if (renderer_damage_reported)
+            {
+                /* The hook repaints the whole buffer, but only the reported
+                 * region differs from the last frame. The scheduled damage is
+                 * kept because software cursors are drawn only inside the
+                 * swap damage. */
+                swap_damage = (renderer_damage |
+                    output_damage->get_scheduled_damage()) * output->handle->scale;
+                swap_damage &= output_damage->get_wlr_damage_box();
+            } else
+            {
+                swap_damage |= output_damage->get_wlr_damage_box();
+            }
         } else
         {
             swap_damage =
@@ -806,13 +1281,46 @@ class wf::render_manager::impl
         depth_buffer_manager->ensure_depth_buffer(
             default_fb.fb, default_fb.viewport_width, default_fb.viewport_height);
 
-        for (auto& row : this->default_streams)
+        default_stream.buffer.fb = current_fb;
+    }
+
+    /**
+     * Whether rendering on the output is suspended, i.e the output is
+     * inhibited and already shows a black frame.
+     */
+    bool is_suspended() const
+    {
+        return output_inhibit_counter && inhibited_frame_committed;
+    }
+
+    /**
+     * Commit a single black frame to an inhibited output. Until the output is
+     * uninhibited, nothing is rendered and no frame_done events are sent.
+     */
+    void paint_inhibited()
+    {
+        frame_stats->begin_phase(FRAME_PHASE_ATTACH);
+        bool needs_swap;
+        if (!output_damage->make_current(needs_swap))
         {
-            for (auto& ws : row)
-            {
-                ws.buffer.fb = current_fb;
-            }
+            wlr_output_rollback(output->handle);
+            frame_stats->end_frame(FRAME_RESULT_SKIPPED);
+            return;
         }
+
+        update_bound_output();
+        OpenGL::render_begin(output->handle->width, output->handle->height,
+            postprocessing->output_fb);
+        OpenGL::clear({0, 0, 0, 1});
+        OpenGL::render_end();
+
+        frame_stats->begin_phase(FRAME_PHASE_SWAP);
+        OpenGL::unbind_output(output);
+        swap_damage = output_damage->get_wlr_damage_box();
+        output_damage->swap_buffers(swap_damage);
+        swap_damage.clear();
+        inhibited_frame_committed = true;
+        frame_stats->end_frame(FRAME_RESULT_RENDERED);
     }
 
     /**
@@ -820,24 +1328,37 @@ class wf::render_manager::impl
      */
     void paint()
     {
+        auto paint_start = std::chrono::steady_clock::now();
+        frame_stats->begin_frame();
+        if (output_inhibit_counter)
+        {
+            paint_inhibited();
+            return;
+        }
+
         /* Part 1: frame setup: query damage, etc. */
+        frame_stats->begin_phase(FRAME_PHASE_EFFECTS);
         effects->run_effects(OUTPUT_EFFECT_PRE);
         effects->run_effects(OUTPUT_EFFECT_DAMAGE);
 
+        frame_stats->begin_phase(FRAME_PHASE_SCANOUT);
         if (do_direct_scanout())
         {
             // Yet another optimization: if we can directly scanout, we should
             // stop the rest of the repaint cycle.
+            frame_stats->end_frame(FRAME_RESULT_SCANOUT);
             return;
         } else
         {
             last_scanout = nullptr;
         }
 
+        frame_stats->begin_phase(FRAME_PHASE_ATTACH);
         bool needs_swap;
         if (!output_damage->make_current(needs_swap))
         {
             wlr_output_rollback(output->handle);
+            frame_stats->end_frame(FRAME_RESULT_SKIPPED);
             return;
         }
 
@@ -847,6 +1368,7 @@ class wf::render_manager::impl
              * and no plugin wants custom redrawing - we can just skip the whole
              * repaint */
             wlr_output_rollback(output->handle);
+            frame_stats->end_frame(FRAME_RESULT_SKIPPED);
             return;
         }
 
@@ -855,41 +1377,120 @@ class wf::render_manager::impl
         // creeps into the current frame damage, if we had skipped a frame.
         output_damage->accumulate_damage();
 
+        int damage_rects = pixman_region32_n_rects(
+            output_damage->frame_damage.to_pixman());
+        output_damage->simplify_damage(damage_max_rects_opt,
+            damage_max_waste_opt);
+        frame_stats->record_damage(damage_rects, pixman_region32_n_rects(
+            output_damage->frame_damage.to_pixman()));
+
         update_bound_output();
+        expand_damage_for_post_effects();
 
         /* Part 2: call the renderer, which sets swap_damage and
          * draws the scenegraph */
+        frame_stats->begin_phase(FRAME_PHASE_RENDER);
         render_output();
 
         /* Part 3: finalize the scene: overlay effects and sw cursors */
+        frame_stats->begin_phase(FRAME_PHASE_OVERLAY);
         effects->run_effects(OUTPUT_EFFECT_OVERLAY);
 
         if (postprocessing->post_effects.size())
         {
-            swap_damage |= output_damage->get_wlr_damage_box();
+            /* The hooks render to the output only in the damaged area, or
+             * everywhere if some hook is not damage-local */
+            int radius = postprocessing->get_damage_radius();
+            if (radius < 0)
+            {
+                swap_damage |= output_damage->get_wlr_damage_box();
+            } else if (renderer && (radius > 0))
+            {
+                /* The damage reported by the render hook was not expanded
+                 * by expand_damage_for_post_effects() */
+                swap_damage.expand_edges(radius);
+                swap_damage &= output_damage->get_wlr_damage_box();
+            }
+
+            postprocessing->set_post_damage(swap_damage);
         }
 
+        frame_stats->begin_phase(FRAME_PHASE_CURSORS);
         OpenGL::render_begin(postprocessing->get_target_framebuffer());
         wlr_output_render_software_cursors(output->handle, swap_damage.to_pixman());
         OpenGL::render_end();
 
         /* Part 4: postprocessing effects */
+        frame_stats->begin_phase(FRAME_PHASE_POST);
         postprocessing->run_post_effects();
-        if (output_inhibit_counter)
-        {
-            OpenGL::render_begin(output->handle->width, output->handle->height,
-                postprocessing->output_fb);
-            OpenGL::clear({0, 0, 0, 1});
-            OpenGL::render_end();
-        }
 
         /* Part 5: finalize frame: swap buffers, send frame_done, etc */
+        frame_stats->begin_phase(FRAME_PHASE_SWAP);
         OpenGL::unbind_output(output);
         output_damage->swap_buffers(swap_damage);
         swap_damage.clear();
+        frame_stats->end_frame(FRAME_RESULT_RENDERED);
+
+        /* Render times are also used to schedule idle work, so they are
+         * recorded even without adaptive repaint delay */
+        repaint_delay.record_render_time(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - paint_start).count());
+        if (adaptive_render_time_opt)
+        {
+            repaint_delay.frame_committed(refresh_nsec);
+        }
         post_paint();
     }
 
+    /* The time of the last frame event, in the presentation clock */
+    int64_t frame_event_nsec = 0;
+    /* Whether the last idle work emission reported more pending work */
+    bool idle_work_pending = false;
+    /* Used to estimate the next frame event if the output does not report
+     * its refresh rate */
+    static constexpr int64_t DEFAULT_REFRESH_NSEC = 16666667;
+
+    /**
+     * Run background work, i.e pre-warming of workspace streams, after the
+     * repaint in a frame event.
+     *
+     * Work is only started if the time left until the next frame event is
+     * longer than the predicted render time of the output, so that it does
+     * not delay the next repaint. If there was not enough time but work is
+     * pending, another frame is requested without forcing a repaint, so that
+     * the work is retried.
+     */
+    void run_idle_work()
+    {
+        if (output_inhibit_counter || (repaint_delay.recorded_frames == 0))
+        {
+            return;
+        }
+
+        int64_t refresh = (refresh_nsec > 0) ? refresh_nsec : DEFAULT_REFRESH_NSEC;
+        int64_t slack   = frame_event_nsec + refresh -
+            repaint_delay.get_presentation_time();
+        if (slack < repaint_delay.predict_render_nsec())
+        {
+            if (idle_work_pending)
+            {
+                wlr_output_schedule_frame(output->handle);
+            }
+
+            return;
+        }
+
+        stream_prewarm_signal_t data;
+        static const signal_id_t stream_prewarm{"workspace-stream-prewarm"};
+        output->render->emit_signal(stream_prewarm, &data);
+        idle_work_pending = data.pending;
+        if (idle_work_pending)
+        {
+            wlr_output_schedule_frame(output->handle);
+        }
+    }
+
     /**
      * Execute post-paint actions.
      */
@@ -905,35 +1506,73 @@ class wf::render_manager::impl
 
     /**
      * Send frame_done to clients.
+     *
+     * Unless a render hook is active, surfaces on other workspaces get no
+     * frame_done, and surfaces fully covered by the opaque regions of the
+     * surfaces above them are throttled according to
+     * core/occluded_frame_interval.
      */
     void send_frame_done()
     {
-        /* TODO: do this only if the view isn't fully occluded by another */
-        std::vector<wayfire_view> visible_views;
+        timespec repaint_ended;
+        clockid_t presentation_clock =
+            wlr_backend_get_presentation_clock(wf::get_core_impl().backend);
+        clock_gettime(presentation_clock, &repaint_ended);
+
         if (renderer)
         {
-            visible_views = output->workspace->get_views_in_layer(
-                wf::VISIBLE_LAYERS);
-        } else
+            /* Render hooks may show any workspace */
+            for (auto& v : output->workspace->get_stacking_order(
+                wf::VISIBLE_LAYERS))
+            {
+                send_frame_done_to_view(v, repaint_ended);
+            }
+
+            return;
+        }
+
+        if (occluded_frame_interval_opt < 0)
         {
-            visible_views = output->workspace->get_views_on_workspace(
-                output->workspace->get_current_workspace(),
-                wf::MIDDLE_LAYERS);
+            auto visible_views = output->workspace->get_views_on_workspace(
+                output->workspace->get_current_workspace(), wf::MIDDLE_LAYERS);
 
             // send to all panels/backgrounds/etc
-            auto additional_views = output->workspace->get_views_in_layer(
+            auto additional_views = output->workspace->get_stacking_order(
                 wf::BELOW_LAYERS | wf::ABOVE_LAYERS);
 
             visible_views.insert(visible_views.end(),
                 additional_views.begin(), additional_views.end());
+            for (auto& v : visible_views)
+            {
+                send_frame_done_to_view(v, repaint_ended);
+            }
+
+            return;
         }
 
-        timespec repaint_ended;
-        clockid_t presentation_clock =
-            wlr_backend_get_presentation_clock(wf::get_core_impl().backend);
-        clock_gettime(presentation_clock, &repaint_ended);
-        for (auto& v : visible_views)
+        bool keepalive = false;
+        if (occluded_frame_interval_opt > 0)
+        {
+            uint32_t now = get_current_time();
+            int64_t interval = occluded_frame_interval_opt;
+            if (now - last_occluded_frame_done >= interval)
+            {
+                keepalive = true;
+                last_occluded_frame_done = now;
+            }
+        }
+
+        auto cws = output->workspace->get_current_workspace();
+        auto output_box = output->get_relative_geometry();
+        wf::region_t covered;
+        for (auto& v : output->workspace->get_stacking_order(wf::VISIBLE_LAYERS))
         {
+            /* Views on other workspaces get no frame events at all */
+            if (!output->workspace->view_visible_on(v, cws))
+            {
+                continue;
+            }
+
             for (auto& view : v->enumerate_views())
             {
                 if (!view->is_mapped())
@@ -941,24 +1580,95 @@ class wf::render_manager::impl
                     continue;
                 }
 
-                for (auto& child : view->enumerate_surfaces())
+                if (!view->is_visible())
+                {
+                    if (keepalive)
+                    {
+                        send_frame_done_to_view(view, repaint_ended, false);
+                    }
+
+                    continue;
+                }
+
+                if (view->has_transformer())
+                {
+                    /* The surfaces of transformed views can be anywhere */
+                    send_frame_done_to_view(view, repaint_ended, false);
+                    covered |= view->get_transformed_opaque_region();
+                    continue;
+                }
+
+                auto origin = wf::origin(view->get_output_geometry());
+                for (auto& child : view->enumerate_surfaces(origin))
                 {
-                    child.surface->send_frame_done(repaint_ended);
+                    auto size = child.surface->get_size();
+                    wf::region_t uncovered{wf::geometry_t{
+                            child.position.x, child.position.y,
+                            size.width, size.height}};
+                    uncovered &= output_box;
+                    uncovered ^= covered;
+
+                    if (!uncovered.empty() || keepalive)
+                    {
+                        child.surface->send_frame_done(repaint_ended);
+                    }
+
+                    covered |= child.surface->get_opaque_region(child.position);
                 }
             }
         }
     }
 
+    uint32_t last_occluded_frame_done = 0;
+
+    /**
+     * Send frame_done to all surfaces of the given view.
+     *
+     * @param with_children Whether to include the view's child views.
+     */
+    void send_frame_done_to_view(wayfire_view v, const timespec& repaint_ended,
+        bool with_children = true)
+    {
+        auto views = with_children ?
+            v->enumerate_views() : std::vector<wayfire_view>{v};
+        for (auto& view : views)
+        {
+            if (!view->is_mapped())
+            {
+                continue;
+            }
+
+            for (auto& child : view->enumerate_surfaces())
+            {
+                child.surface->send_frame_done(repaint_ended);
+            }
+        }
+    }
+
     /* Workspace stream implementation */
     void workspace_stream_start(workspace_stream_t& stream)
     {
         stream.running = true;
-        stream.scale_x = stream.scale_y = 1;
 
         /* damage the whole workspace region, so that we get a full repaint
          * when updating the workspace */
         output_damage->damage(output_damage->get_ws_box(stream.ws));
-        workspace_stream_update(stream, 1, 1);
+        workspace_stream_update(stream, stream.scale_x, stream.scale_y);
+    }
+
+    /**
+     * Get the scale at which a stream is rendered, given the requested scale.
+     *
+     * Streams are scaled uniformly, with the larger of the requested factors,
+     * so that they never have less detail than requested. The scale is also
+     * rounded up to a multiple of 1/8, so that animations which change the
+     * requested scale each frame do not reallocate the buffer each frame.
+     */
+    static float get_stream_scale(float scale_x, float scale_y)
+    {
+        float scale = std::max(scale_x, scale_y);
+
+        return wf::clamp(std::ceil(scale * 8.0f) / 8.0f, 0.125f, 1.0f);
     }
 
     /**
@@ -976,7 +1686,37 @@ class wf::render_manager::impl
         wf::region_t damage;
     };
 
-    using damaged_surface = std::unique_ptr<damaged_surface_t>;
+    /**
+     * The surfaces scheduled for repainting by workspace stream updates.
+     *
+     * Records are never destroyed, only reset, so that after the first few
+     * frames the list and the damage regions of the records already have
+     * enough storage and scheduling surfaces does not allocate anymore.
+     * A deque keeps references to the records valid if a nested stream update
+     * appends to the list while rendering.
+     */
+    struct repaint_list_t
+    {
+        std::deque<damaged_surface_t> records;
+        size_t size = 0;
+
+        /** Get a free record at the end of the list. */
+        damaged_surface_t& push()
+        {
+            if (size == records.size())
+            {
+                records.emplace_back();
+            }
+
+            auto& ds = records[size++];
+            ds.surface = nullptr;
+            ds.view    = nullptr;
+
+            return ds;
+        }
+    };
+
+    repaint_list_t repaint_list;
 
     /**
      * Represents the state while calculating what parts of the output
@@ -984,7 +1724,10 @@ class wf::render_manager::impl
      */
     struct workspace_stream_repaint_t
     {
-        std::vector<damaged_surface> to_render;
+        /* The scheduled surfaces are repaint_list.records[first..last) */
+        size_t first = 0;
+        size_t last  = 0;
+
         wf::region_t ws_damage;
         wf::framebuffer_t fb;
 
@@ -992,6 +1735,32 @@ class wf::render_manager::impl
         int ws_dy;
     };
 
+    /**
+     * Start a new record in the repaint list. Its damage is set to the
+     * intersection of the workspace damage and the given box.
+     *
+     * @return The record, or nullptr if the damage would be empty.
+     */
+    damaged_surface_t *push_damaged_surface(workspace_stream_repaint_t& repaint,
+        const wf::geometry_t& box)
+    {
+        auto& ds = repaint_list.push();
+
+        /* Intersect into the existing region to reuse its storage */
+        pixman_region32_intersect_rect(ds.damage.to_pixman(),
+            repaint.ws_damage.to_pixman(), box.x, box.y, box.width, box.height);
+        if (ds.damage.empty())
+        {
+            --repaint_list.size;
+
+            return nullptr;
+        }
+
+        repaint.last = repaint_list.size;
+
+        return &ds;
+    }
+
     /**
      * Calculate the damaged region of a view which renders with its snapshot
      * and add it to the render list
@@ -1001,17 +1770,14 @@ class wf::render_manager::impl
     void schedule_snapshotted_view(workspace_stream_repaint_t& repaint,
         wayfire_view view, wf::point_t view_delta)
     {
-        auto ds = damaged_surface(new damaged_surface_t);
-
         auto bbox = view->get_bounding_box() + view_delta;
-        ds->damage = (repaint.ws_damage & bbox) + -view_delta;
-        if (!ds->damage.empty())
+        if (auto ds = push_damaged_surface(repaint, bbox))
         {
+            ds->damage += -view_delta;
             ds->pos  = -view_delta;
             ds->view = view.get();
             repaint.ws_damage ^=
                 view->get_transformed_opaque_region() + view_delta;
-            repaint.to_render.push_back(std::move(ds));
         }
     }
 
@@ -1032,7 +1798,6 @@ class wf::render_manager::impl
             return;
         }
 
-        auto ds = damaged_surface(new damaged_surface_t);
         wlr_box obox = {
             .x     = pos.x,
             .y     = pos.y,
@@ -1040,16 +1805,14 @@ class wf::render_manager::impl
             .height = surface->get_size().height
         };
 
-        ds->damage = repaint.ws_damage & obox;
-        if (!ds->damage.empty())
+        if (auto ds = push_damaged_surface(repaint, obox))
         {
             ds->pos     = pos;
             ds->surface = surface;
 
             /* Subtract opaque region from workspace damage. The views below
              * won't be visible, so no need to damage them */
-            repaint.ws_damage ^= ds->surface->get_opaque_region(pos);
-            repaint.to_render.push_back(std::move(ds));
+            repaint.ws_damage ^= surface->get_opaque_region(pos);
         }
     }
 
@@ -1149,7 +1912,20 @@ class wf::render_manager::impl
         workspace_stream_t& stream, float scale_x, float scale_y)
     {
         workspace_stream_repaint_t repaint;
-        repaint.ws_damage = output_damage->get_ws_damage(stream.ws);
+        /* The stream may have missed the damage of the frames in which it
+         * was not updated */
+        repaint.ws_damage = output_damage->get_ws_damage(stream.ws,
+            stream.last_frame);
+        stream.last_frame = output_damage->frame_seq;
+        repaint.first     = repaint.last = repaint_list.size;
+
+        float scale = get_stream_scale(scale_x, scale_y);
+        if ((scale != stream.scale_x) || (scale != stream.scale_y))
+        {
+            /* The old contents are at a different resolution */
+            stream.scale_x = stream.scale_y = scale;
+            repaint.ws_damage |= output_damage->get_ws_box(stream.ws);
+        }
 
         /* we don't have to update anything */
         if (repaint.ws_damage.empty())
@@ -1157,18 +1933,19 @@ class wf::render_manager::impl
             return repaint;
         }
 
-        if ((scale_x != stream.scale_x) || (scale_y != stream.scale_y))
-        {
-            /* FIXME: enable scaled rendering */
-            // stream->scale_x = scale_x;
-            // stream->scale_y = scale_y;
-
-            // ws_damage |= get_damage_box();
-        }
+        int buffer_width  = std::max(1, (int)std::round(
+            output->handle->width * scale));
+        int buffer_height = std::max(1, (int)std::round(
+            output->handle->height * scale));
 
         OpenGL::render_begin();
-        stream.buffer.allocate(output->handle->width, output->handle->height);
+        bool allocated = stream.buffer.allocate(buffer_width, buffer_height);
         OpenGL::render_end();
+        stream.last_used = wf::get_current_time();
+        if (allocated)
+        {
+            enforce_stream_memory_budget();
+        }
 
         repaint.fb = postprocessing->get_target_framebuffer();
         if ((stream.buffer.tex != 0))
@@ -1176,6 +1953,9 @@ class wf::render_manager::impl
             /* Use the workspace buffers */
             repaint.fb.fb  = stream.buffer.fb;
             repaint.fb.tex = stream.buffer.tex;
+            repaint.fb.viewport_width  = buffer_width;
+            repaint.fb.viewport_height = buffer_height;
+            repaint.fb.scale *= scale;
         }
 
         auto g   = output->get_relative_geometry();
@@ -1186,6 +1966,19 @@ class wf::render_manager::impl
         repaint.fb.geometry.x = repaint.ws_dx;
         repaint.fb.geometry.y = repaint.ws_dy;
 
+        if (scale < 1.0)
+        {
+            /* A stream pixel spans several logical pixels. Extend the damage
+             * to whole stream pixels, otherwise pixels which are only partially
+             * damaged would not be repainted. */
+            wf::point_t origin = {repaint.ws_dx, repaint.ws_dy};
+            auto damage = (repaint.ws_damage + -origin) * repaint.fb.scale;
+            damage.expand_edges(1);
+            damage *= 1.0 / repaint.fb.scale;
+            repaint.ws_damage = (damage + origin) & output_damage->get_ws_box(
+                stream.ws);
+        }
+
         return repaint;
     }
 
@@ -1215,22 +2008,23 @@ class wf::render_manager::impl
     {
         wf::geometry_t fb_geometry = repaint.fb.geometry;
 
-        for (auto& ds : wf::reverse(repaint.to_render))
+        for (size_t i = repaint.last; i > repaint.first; i--)
         {
-            if (ds->view)
+            auto& ds = repaint_list.records[i - 1];
+            if (ds.view)
             {
-                repaint.fb.geometry = fb_geometry + ds->pos;
-                ds->view->render_transformed(repaint.fb, ds->damage);
-                for (auto& child : ds->view->enumerate_surfaces({0, 0}))
+                repaint.fb.geometry = fb_geometry + ds.pos;
+                ds.view->render_transformed(repaint.fb, ds.damage);
+                for (auto& child : ds.view->enumerate_surfaces({0, 0}))
                 {
                     send_sampled_on_output(child.surface);
                 }
             } else
             {
                 repaint.fb.geometry = fb_geometry;
-                ds->surface->simple_render(repaint.fb,
-                    ds->pos.x, ds->pos.y, ds->damage);
-                send_sampled_on_output(ds->surface);
+                ds.surface->simple_render(repaint.fb,
+                    ds.pos.x, ds.pos.y, ds.damage);
+                send_sampled_on_output(ds.surface);
             }
         }
 
@@ -1238,7 +2032,7 @@ class wf::render_manager::impl
         repaint.fb.geometry = fb_geometry;
     }
 
-    void workspace_stream_update(workspace_stream_t& stream,
+    bool workspace_stream_update(workspace_stream_t& stream,
         float scale_x = 1, float scale_y = 1)
     {
         workspace_stream_repaint_t repaint =
@@ -1246,16 +2040,20 @@ class wf::render_manager::impl
 
         if (repaint.ws_damage.empty())
         {
-            return;
+            return false;
         }
 
         {
             stream_signal_t data(stream.ws, repaint.ws_damage, repaint.fb);
-            output->render->emit_signal("workspace-stream-pre", &data);
+            static const signal_id_t stream_pre{"workspace-stream-pre"};
+            output->render->emit_signal(stream_pre, &data);
         }
 
         check_schedule_surfaces(repaint, stream);
 
+        /* Keep the stream framebuffer bound for the whole update, so that
+         * the render blocks of the individual surfaces are cheap */
+        OpenGL::render_begin(repaint.fb);
         if (stream.background.a < 0)
         {
             clear_empty_areas(repaint, background_color_opt);
@@ -1265,17 +2063,200 @@ class wf::render_manager::impl
         }
 
         render_views(repaint);
+        OpenGL::render_end();
+        repaint_list.size = repaint.first;
 
         unschedule_drag_icon();
         {
             stream_signal_t data(stream.ws, repaint.ws_damage, repaint.fb);
-            output->render->emit_signal("workspace-stream-post", &data);
+            static const signal_id_t stream_post{"workspace-stream-post"};
+            output->render->emit_signal(stream_post, &data);
         }
+
+        return true;
     }
 
     void workspace_stream_stop(workspace_stream_t& stream)
     {
-        stream.running = false;
+        stream.running   = false;
+        stream.last_used = wf::get_current_time();
+        enforce_stream_memory_budget();
+        schedule_stream_release();
+    }
+
+    static size_t get_stream_buffer_size(const workspace_stream_t& stream)
+    {
+        /* Default streams render directly to the output */
+        const auto& buffer = stream.buffer;
+        if ((buffer.tex == (uint32_t)-1) || (buffer.tex == 0))
+        {
+            return 0;
+        }
+
+        return size_t(buffer.viewport_width) * buffer.viewport_height * 4;
+    }
+
+    static std::vector<workspace_stream_t*> enumerate_streams(output_t *output)
+    {
+        stream_enumerate_signal_t data;
+        static const signal_id_t stream_enumerate{"workspace-stream-enumerate"};
+        output->render->emit_signal(stream_enumerate, &data);
+
+        return data.streams;
+    }
+
+    size_t get_workspace_stream_memory()
+    {
+        size_t total = 0;
+        for (auto stream : enumerate_streams(output))
+        {
+            total += get_stream_buffer_size(*stream);
+        }
+
+        return total;
+    }
+
+    wf::option_wrapper_t<int> stream_memory_budget_opt{"core/stream_memory_budget"};
+
+    /**
+     * Release the buffers of stopped streams on all outputs, least recently
+     * used first, until the buffers of all streams fit in the budget.
+     */
+    void enforce_stream_memory_budget()
+    {
+        size_t budget = size_t(std::max(0, (int)stream_memory_budget_opt)) << 20;
+        if (budget == 0)
+        {
+            return;
+        }
+
+        size_t total = 0;
+        std::vector<workspace_stream_t*> stopped;
+        for (auto wo : wf::get_core().output_layout->get_outputs())
+        {
+            for (auto stream : enumerate_streams(wo))
+            {
+                total += get_stream_buffer_size(*stream);
+                if (!stream->running && get_stream_buffer_size(*stream))
+                {
+                    stopped.push_back(stream);
+                }
+            }
+        }
+
+        if (total <= budget)
+        {
+            return;
+        }
+
+        std::sort(stopped.begin(), stopped.end(), [] (auto a, auto b)
+        {
+            return a->last_used < b->last_used;
+        });
+
+        OpenGL::render_begin();
+        for (size_t i = 0; i < stopped.size() && total > budget; i++)
+        {
+            total -= get_stream_buffer_size(*stopped[i]);
+            stopped[i]->buffer.release();
+        }
+
+        OpenGL::render_end();
+    }
+
+    wf::option_wrapper_t<int> stream_release_timeout_opt{
+        "core/stream_release_timeout"};
+    wf::wl_timer stream_release_timer;
+
+    /**
+     * Release the buffers of the streams on this output which have been
+     * stopped for longer than core/stream_release_timeout, and schedule the
+     * next check for when the oldest of the remaining stopped streams expires.
+     */
+    void release_idle_streams()
+    {
+        int64_t timeout = int64_t(stream_release_timeout_opt) * 1000;
+        if (timeout <= 0)
+        {
+            stream_release_timer.disconnect();
+            return;
+        }
+
+        uint32_t now = wf::get_current_time();
+        int64_t next_check = -1;
+        bool rendering     = false;
+        for (auto stream : enumerate_streams(output))
+        {
+            if (stream->running || !get_stream_buffer_size(*stream))
+            {
+                continue;
+            }
+
+            /* Unsigned difference, so that timestamp wraparound is handled */
+            int64_t idle = uint32_t(now - stream->last_used);
+            if (idle < timeout)
+            {
+                next_check = (next_check < 0 ? timeout - idle :
+                    std::min(next_check, timeout - idle));
+                continue;
+            }
+
+            if (!rendering)
+            {
+                OpenGL::render_begin();
+                rendering = true;
+            }
+
+            stream->buffer.release();
+        }
+
+        if (rendering)
+        {
+            OpenGL::render_end();
+        }
+
+        if (next_check > 0)
+        {
+            stream_release_timer.set_timeout(next_check,
+                [=] () { release_idle_streams(); });
+        } else
+        {
+            stream_release_timer.disconnect();
+        }
+    }
+
+    /**
+     * Make sure the buffer of a stream which was just stopped gets released
+     * when it expires. Streams stopped earlier expire sooner, so a pending
+     * check is never later than needed.
+     */
+    void schedule_stream_release()
+    {
+        int timeout = stream_release_timeout_opt;
+        if ((timeout > 0) && !stream_release_timer.is_connected())
+        {
+            stream_release_timer.set_timeout(timeout * 1000,
+                [=] () { release_idle_streams(); });
+        }
+    }
+
+    /** Log the number of workspace streams and stream buffers on the output. */
+    void dump_stream_stats()
+    {
+        int total = 0, running = 0, buffers = 0;
+        size_t memory = 0;
+        for (auto stream : enumerate_streams(output))
+        {
+            size_t size = get_stream_buffer_size(*stream);
+            ++total;
+            running += stream->running ? 1 : 0;
+            buffers += size ? 1 : 0;
+            memory  += size;
+        }
+
+        LOGI("Workspace streams on output ", output->to_string(), ": ", total,
+            " streams, ", running, " running, ", buffers, " buffers using ",
+            memory / 1024, " KiB");
     }
 };
 
@@ -1288,6 +2269,11 @@ void render_manager::set_renderer(render_hook_t rh)
     pimpl->set_renderer(rh);
 }
 
+void render_manager::report_renderer_damage(const wf::region_t& damage)
+{
+    pimpl->report_renderer_damage(damage);
+}
+
 void render_manager::set_redraw_always(bool always)
 {
     pimpl->set_redraw_always(always);
@@ -1320,7 +2306,17 @@ void render_manager::rem_effect(effect_hook_t *hook)
 
 void render_manager::add_post(post_hook_t *hook)
 {
-    pimpl->postprocessing->add_post(hook);
+    pimpl->postprocessing->add_post(hook, -1);
+}
+
+void render_manager::add_post(post_hook_t *hook, int sampling_radius)
+{
+    pimpl->postprocessing->add_post(hook, std::max(sampling_radius, 0));
+}
+
+const wf::region_t& render_manager::get_post_damage()
+{
+    return pimpl->postprocessing->post_damage;
 }
 
 void render_manager::rem_post(post_hook_t *hook)
@@ -1368,10 +2364,15 @@ void render_manager::workspace_stream_start(workspace_stream_t& stream)
     pimpl->workspace_stream_start(stream);
 }
 
-void render_manager::workspace_stream_update(workspace_stream_t& stream,
+bool render_manager::workspace_stream_update(workspace_stream_t& stream,
     float scale_x, float scale_y)
 {
-    pimpl->workspace_stream_update(stream);
+    return pimpl->workspace_stream_update(stream, scale_x, scale_y);
+}
+
+size_t render_manager::get_workspace_stream_memory()
+{
+    return pimpl->get_workspace_stream_memory();
 }
 
 void render_manager::workspace_stream_stop(workspace_stream_t& stream)
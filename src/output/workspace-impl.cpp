@@ -5,7 +5,9 @@
 #include <wayfire/render-manager.hpp>
 #include <wayfire/signal-definitions.hpp>
 #include <wayfire/opengl.hpp>
+#include <cmath>
 #include <list>
+#include <unordered_map>
 #include <algorithm>
 #include <wayfire/nonstd/reverse.hpp>
 #include <wayfire/util/log.hpp>
@@ -14,61 +16,57 @@
 
 namespace wf
 {
-/** Find a smart pointer inside a list */
-template<class Haystack, class Needle>
-typename std::list<Haystack>::iterator find_in(std::list<Haystack>& hay,
-    const Needle& needle)
+/** Divide and round towards negative infinity */
+static int floor_div(int a, int b)
 {
-    return std::find_if(std::begin(hay), std::end(hay), [=] (const auto& elem)
-    {
-        return elem.get() == needle.get();
-    });
+    return (a >= 0) ? a / b : -((-a + b - 1) / b);
 }
 
-/** Bring to front or lower to back inside a container of smart pointers */
-template<class Haystack, class Needle>
-void raise_to_front(std::list<Haystack>& hay, const Needle& needle,
-    bool reverse = false)
+/**
+ * @return The bounding box of the view merged with its wm geometry, i.e the
+ *   area in which the view can be visible.
+ */
+static wf::geometry_t get_view_extents(wayfire_view view)
 {
-    auto it = find_in(hay, needle);
-    hay.splice(reverse ? hay.end() : hay.begin(), hay, it);
+    auto bbox = view->get_bounding_box();
+    auto wm   = view->get_wm_geometry();
+    int x1    = std::min(bbox.x, wm.x);
+    int y1    = std::min(bbox.y, wm.y);
+    int x2    = std::max(bbox.x + bbox.width, wm.x + wm.width);
+    int y2    = std::max(bbox.y + bbox.height, wm.y + wm.height);
+
+    return {x1, y1, x2 - x1, y2 - y1};
 }
 
-/** Reorder list so that @element is directly above @below. */
-template<class Haystack, class Needle>
-void reorder_above(
-    std::list<Haystack>& list, const Needle& element, const Needle& below)
+/*
+ * The positions of views and sublayers in their lists are saved, and the
+ * helpers below move elements with splice(), which does not invalidate any
+ * iterators. Thus, restacking is O(1).
+ */
+
+/** Bring to front or lower to back the element at @element */
+template<class T>
+void raise_to_front(std::list<T>& list, typename std::list<T>::iterator element,
+    bool reverse = false)
 {
-    auto element_it = find_in(list, element);
-    auto pos = find_in(list, below);
-    list.splice(pos, list, element_it);
+    list.splice(reverse ? list.end() : list.begin(), list, element);
 }
 
-/** Reorder list so that @element is directly below @above. */
-template<class Haystack, class Needle>
-void reorder_below(
-    std::list<Haystack>& list, const Needle& element, const Needle& above)
+/** Reorder list so that @element is directly above @below. */
+template<class T>
+void reorder_above(std::list<T>& list,
+    typename std::list<T>::iterator element, typename std::list<T>::iterator below)
 {
-    auto element_it = find_in(list, element);
-    auto pos = find_in(list, above);
-    assert(pos != list.end());
-    list.splice(std::next(pos), list, element_it);
+    list.splice(below, list, element);
 }
 
-/**
- * Remove needle from haystack, where both needle and elements in haystack are
- * smart pointers.
- */
-template<class Haystack, class Needle>
-void remove_from(Haystack& haystack, Needle& n)
+/** Reorder list so that @element is directly below @above. */
+template<class T>
+void reorder_below(std::list<T>& list,
+    typename std::list<T>::iterator element, typename std::list<T>::iterator above)
 {
-    auto it = std::remove_if(std::begin(haystack), std::end(haystack),
-        [=] (const auto& contained)
-    {
-        return contained.get() == n.get();
-    });
-
-    haystack.erase(it, std::end(haystack));
+    assert(above != list.end());
+    list.splice(std::next(above), list, element);
 }
 
 struct layer_container_t;
@@ -92,6 +90,9 @@ struct sublayer_t
      * elsewhere.
      */
     bool is_single_view;
+
+    /** The position of the sublayer in the layer's list for its mode */
+    std::list<std::unique_ptr<sublayer_t>>::iterator position;
 };
 
 /**
@@ -110,13 +111,26 @@ struct layer_container_t
     /** List of sublayers docked above */
     sublayer_container_t above;
 
-    void remove_sublayer(nonstd::observer_ptr<sublayer_t> sublayer)
+    /** @return The list of sublayers with the given mode */
+    sublayer_container_t& get_sublayers(sublayer_mode_t mode)
     {
-        for (auto container : {& below, & floating, & above})
+        switch (mode)
         {
-            remove_from(*container, sublayer);
+          case SUBLAYER_DOCKED_BELOW:
+            return below;
+
+          case SUBLAYER_DOCKED_ABOVE:
+            return above;
+
+          default:
+            return floating;
         }
     }
+
+    void remove_sublayer(nonstd::observer_ptr<sublayer_t> sublayer)
+    {
+        get_sublayers(sublayer->mode).erase(sublayer->position);
+    }
 };
 
 /**
@@ -127,6 +141,19 @@ class output_layer_manager_t
 {
     layer_container_t layers[TOTAL_LAYERS];
 
+    /* The stacking order of the views in a set of layers */
+    struct cached_order_t
+    {
+        uint32_t layers_mask;
+        uint64_t generation;
+        std::shared_ptr<std::vector<wayfire_view>> views;
+    };
+
+    /* Incremented whenever the stacking order changes */
+    uint64_t generation = 0;
+    /* Few distinct masks are used, so a linear search is enough */
+    std::vector<cached_order_t> cached_orders;
+
   public:
     output_layer_manager_t()
     {
@@ -171,7 +198,7 @@ class output_layer_manager_t
 
         view->damage();
 
-        remove_from(sublayer->views, view);
+        sublayer->views.erase(view->view_impl->sublayer_position);
         if (sublayer->is_single_view)
         {
             sublayer->layer->remove_sublayer(sublayer);
@@ -179,6 +206,22 @@ class output_layer_manager_t
 
         /* Reset the view's sublayer */
         sublayer = nullptr;
+        invalidate_stacking_order();
+    }
+
+    /**
+     * Mark the cached stacking orders as outdated. Needs to be called
+     * whenever views are added, removed, reordered or (un)promoted.
+     */
+    void invalidate_stacking_order()
+    {
+        ++generation;
+    }
+
+    /** @return A counter incremented whenever the stacking order changes */
+    uint64_t get_generation() const
+    {
+        return generation;
     }
 
     void add_view_to_sublayer(wayfire_view view,
@@ -187,6 +230,8 @@ class output_layer_manager_t
         remove_view(view);
         get_view_sublayer(view) = sublayer;
         sublayer->views.push_front(view);
+        view->view_impl->sublayer_position = sublayer->views.begin();
+        invalidate_stacking_order();
     }
 
     nonstd::observer_ptr<sublayer_t> create_sublayer(layer_t layer_mask,
@@ -200,18 +245,18 @@ class output_layer_manager_t
         sublayer->mode  = mode;
         sublayer->is_single_view = false;
 
+        auto& sublayers = layer.get_sublayers(mode);
         switch (mode)
         {
           case SUBLAYER_DOCKED_BELOW:
-            layer.below.emplace_back(std::move(sublayer));
+            sublayers.emplace_back(std::move(sublayer));
+            ptr->position = std::prev(sublayers.end());
             break;
 
           case SUBLAYER_DOCKED_ABOVE:
-            layer.above.emplace_front(std::move(sublayer));
-            break;
-
           case SUBLAYER_FLOATING:
-            layer.floating.emplace_front(std::move(sublayer));
+            sublayers.emplace_front(std::move(sublayer));
+            ptr->position = sublayers.begin();
             break;
         }
 
@@ -222,7 +267,9 @@ class output_layer_manager_t
     void add_view_to_layer(wayfire_view view, layer_t layer)
     {
         view->damage();
-        add_view_to_sublayer(view, create_sublayer(layer, SUBLAYER_FLOATING));
+        auto sublayer = create_sublayer(layer, SUBLAYER_FLOATING);
+        sublayer->is_single_view = true;
+        add_view_to_sublayer(view, sublayer);
         view->damage();
     }
 
@@ -235,21 +282,22 @@ class output_layer_manager_t
         assert(sublayer);
         if (sublayer->mode == SUBLAYER_FLOATING)
         {
-            raise_to_front(sublayer->layer->floating, sublayer);
+            raise_to_front(sublayer->layer->floating, sublayer->position);
         }
 
-        raise_to_front(sublayer->views, view);
+        raise_to_front(sublayer->views, view->view_impl->sublayer_position);
+        invalidate_stacking_order();
     }
 
     wayfire_view get_front_view(wf::layer_t layer)
     {
-        auto views = get_views_in_layer(layer);
-        if (views.size() == 0)
+        auto views = get_stacking_order(layer);
+        if (views.empty())
         {
             return nullptr;
         }
 
-        return views.front();
+        return views[0];
     }
 
     /** Precondition: view and below are in the same layer */
@@ -260,10 +308,13 @@ class output_layer_manager_t
         auto view_sublayer  = get_view_sublayer(view);
         auto below_sublayer = get_view_sublayer(below);
         assert(view_sublayer->layer == below_sublayer->layer);
+        invalidate_stacking_order();
 
         if (view_sublayer == below_sublayer)
         {
-            reorder_above(view_sublayer->views, view, below);
+            reorder_above(view_sublayer->views,
+                view->view_impl->sublayer_position,
+                below->view_impl->sublayer_position);
 
             return;
         }
@@ -274,8 +325,11 @@ class output_layer_manager_t
             return;
         }
 
-        reorder_above(view_sublayer->layer->floating, view_sublayer, below_sublayer);
-        raise_to_front(view_sublayer->views, view, true); // bring to back == reverse
+        reorder_above(view_sublayer->layer->floating, view_sublayer->position,
+            below_sublayer->position);
+        // bring to back == reverse
+        raise_to_front(view_sublayer->views, view->view_impl->sublayer_position,
+            true);
     }
 
     /** Precondition: view and above are in the same layer */
@@ -286,10 +340,13 @@ class output_layer_manager_t
         auto view_sublayer  = get_view_sublayer(view);
         auto above_sublayer = get_view_sublayer(above);
         assert(view_sublayer->layer == above_sublayer->layer);
+        invalidate_stacking_order();
 
         if (view_sublayer == above_sublayer)
         {
-            reorder_below(view_sublayer->views, view, above);
+            reorder_below(view_sublayer->views,
+                view->view_impl->sublayer_position,
+                above->view_impl->sublayer_position);
 
             return;
         }
@@ -300,12 +357,14 @@ class output_layer_manager_t
             return;
         }
 
-        reorder_below(view_sublayer->layer->floating, view_sublayer, above_sublayer);
-        raise_to_front(view_sublayer->views, view);
+        reorder_below(view_sublayer->layer->floating, view_sublayer->position,
+            above_sublayer->position);
+        raise_to_front(view_sublayer->views, view->view_impl->sublayer_position);
     }
 
-    void push_views(std::vector<wayfire_view>& into, layer_t layer_e,
-        bool promoted)
+    template<class Filter>
+    void collect_views(std::vector<wayfire_view>& into, layer_t layer_e,
+        Filter filter)
     {
         auto& layer = this->layers[layer_index_from_mask(layer_e)];
         for (const auto& sublayers :
@@ -315,17 +374,71 @@ class output_layer_manager_t
             {
                 auto& container = sublayer->views;
                 std::copy_if(container.begin(), container.end(),
-                    std::back_inserter(into), [=] (wayfire_view view)
-                {
-                    return view->view_impl->is_promoted == promoted;
-                });
+                    std::back_inserter(into), filter);
             }
         }
     }
 
-    std::vector<wayfire_view> get_views_in_layer(uint32_t layers_mask)
+    void push_views(std::vector<wayfire_view>& into, layer_t layer_e,
+        bool promoted)
+    {
+        collect_views(into, layer_e, [=] (wayfire_view view)
+        {
+            return view->view_impl->is_promoted == promoted;
+        });
+    }
+
+    /**
+     * @return The views in the given layer from top to bottom, in the order
+     *   they would have if none of them were promoted.
+     */
+    std::vector<wayfire_view> get_views_ignoring_promotion(layer_t layer)
     {
         std::vector<wayfire_view> views;
+        collect_views(views, layer, [] (wayfire_view) { return true; });
+
+        return views;
+    }
+
+    stacking_order_t get_stacking_order(uint32_t layers_mask)
+    {
+        auto it = std::find_if(cached_orders.begin(), cached_orders.end(),
+            [=] (const cached_order_t& order)
+        {
+            return order.layers_mask == layers_mask;
+        });
+
+        if (it == cached_orders.end())
+        {
+            cached_orders.push_back({layers_mask, generation,
+                std::make_shared<std::vector<wayfire_view>>()});
+            it = std::prev(cached_orders.end());
+            build_views_in_layer(*it->views, layers_mask);
+        } else if (it->generation != generation)
+        {
+            /* Snapshots handed out earlier may still be in use, in which case
+             * they must not change. Otherwise, reuse the storage. */
+            if (it->views.use_count() > 1)
+            {
+                it->views = std::make_shared<std::vector<wayfire_view>>();
+            }
+
+            it->views->clear();
+            build_views_in_layer(*it->views, layers_mask);
+            it->generation = generation;
+        }
+
+        return stacking_order_t{it->views};
+    }
+
+    std::vector<wayfire_view> get_views_in_layer(uint32_t layers_mask)
+    {
+        return get_stacking_order(layers_mask).get();
+    }
+
+    void build_views_in_layer(std::vector<wayfire_view>& views,
+        uint32_t layers_mask)
+    {
         auto try_push = [&] (layer_t layer, bool promoted = false)
         {
             if (!(layer & layers_mask))
@@ -353,7 +466,6 @@ class output_layer_manager_t
         }
 
         try_push(LAYER_MINIMIZED);
-        return views;
     }
 
     std::vector<wayfire_view> get_promoted_views()
@@ -388,6 +500,558 @@ class output_layer_manager_t
     }
 };
 
+/**
+ * output_view_index_t is a part of the workspace_manager module. It is a
+ * uniform grid of the bounding boxes of the views on the output, used to find
+ * the views at a point or on a workspace without computing the bounding box of
+ * every view on each query.
+ *
+ * The grid covers the whole workspace grid, with each workspace split into
+ * CELLS_PER_WORKSPACE x CELLS_PER_WORKSPACE cells. Each cell holds the indices
+ * of the views whose box intersects it, in stacking order.
+ *
+ * Boxes are cached and recomputed only for views which were damaged or whose
+ * geometry changed, because a view cannot change its bounding box without
+ * damaging itself. The list of views is synchronized with the stacking order
+ * and on map/unmap. When a box changes, only the cells of that view are
+ * updated. All cells are rebuilt only when the order of the views or the
+ * grid changes.
+ */
+class output_view_index_t
+{
+    static constexpr int CELLS_PER_WORKSPACE = 4;
+
+    struct entry_t
+    {
+        wayfire_view view;
+        /* The toplevel view in the layers which this view belongs to */
+        wayfire_view toplevel;
+        /* The layer of the toplevel view */
+        uint32_t layer = 0;
+        /* Whether the view is considered for input, i.e it is returned by
+         * enumerate_views() of its toplevel */
+        bool input = false;
+        /* Whether the box needs to be recomputed */
+        bool dirty = true;
+        bool sticky = false;
+        /* The bounding box merged with the wm geometry */
+        wf::geometry_t box = {0, 0, 0, 0};
+        /* The position of the entry in entries */
+        uint32_t index = 0;
+
+        wf::signal_connection_t on_damage;
+        wf::typed_connection_t<view_geometry_changed_signal> on_geometry_changed;
+    };
+
+    output_t *output;
+    output_layer_manager_t& layer_manager;
+
+    /* All views, in the order in which input_surface_at() tries them */
+    std::vector<std::unique_ptr<entry_t>> entries;
+    std::vector<entry_t*> dirty_entries;
+    /* The layer manager generation at the last synchronization */
+    uint64_t synced_generation = -1;
+    /* Whether views were (un)mapped since the last synchronization */
+    bool views_changed = true;
+    /* Changed whenever the list of views or any box changes, see get_serial() */
+    uint64_t serial = 0;
+
+    std::vector<std::vector<uint32_t>> cells;
+    /* Indices of sticky toplevels, which are visible on all workspaces */
+    std::vector<uint32_t> sticky_entries;
+    bool cells_dirty = true;
+    /* The parameters the cells were built with */
+    wf::dimensions_t cell_size = {1, 1};
+    wf::dimensions_t grid_size = {0, 0};
+    wf::point_t grid_offset    = {0, 0};
+
+    signal_connection_t on_view_mapped = [=] (signal_data_t*)
+    {
+        views_changed = true;
+    };
+
+    void bump_serial()
+    {
+        /* Shared by all outputs, so that serials of different outputs never
+         * compare equal */
+        static uint64_t last_serial = 0;
+        serial = ++last_serial;
+    }
+
+    void mark_dirty(entry_t *entry)
+    {
+        if (!entry->dirty)
+        {
+            entry->dirty = true;
+            dirty_entries.push_back(entry);
+        }
+    }
+
+    std::unique_ptr<entry_t> create_entry(wayfire_view view)
+    {
+        static const wf::signal_id_t region_damaged{"region-damaged"};
+
+        auto entry = std::make_unique<entry_t>();
+        entry->view = view;
+        auto ptr = entry.get();
+        entry->on_damage.set_callback([=] (signal_data_t*)
+        {
+            mark_dirty(ptr);
+        });
+        entry->on_geometry_changed.set_callback(
+            [=] (view_geometry_changed_signal*)
+        {
+            mark_dirty(ptr);
+        });
+
+        view->connect_signal(region_damaged, &entry->on_damage);
+        view->connect(&entry->on_geometry_changed);
+
+        return entry;
+    }
+
+    /**
+     * Rebuild the list of views from the stacking order, reusing entries.
+     * Boxes of reused entries are kept, since they are kept up to date by the
+     * damage and geometry signals.
+     */
+    void synchronize()
+    {
+        std::vector<entry_t*> old_order;
+        std::unordered_map<view_interface_t*, std::unique_ptr<entry_t>> old;
+        for (auto& entry : entries)
+        {
+            old_order.push_back(entry.get());
+            old[entry->view.get()] = std::move(entry);
+        }
+
+        entries.clear();
+        bool toplevels_changed  = false;
+        bool attributes_changed = false;
+        auto add_entry = [&] (wayfire_view view, wayfire_view toplevel,
+                              bool input)
+        {
+            auto it = old.find(view.get());
+            if (it == old.end())
+            {
+                entries.push_back(create_entry(view));
+            } else
+            {
+                entries.push_back(std::move(it->second));
+                old.erase(it);
+            }
+
+            auto& entry = entries.back();
+            auto layer  = layer_manager.get_view_layer(toplevel);
+            toplevels_changed  |= (entry->toplevel != toplevel);
+            attributes_changed |= (entry->layer != layer) ||
+                (entry->input != input);
+
+            entry->toplevel = toplevel;
+            entry->layer    = layer;
+            entry->input    = input;
+            entry->index    = entries.size() - 1;
+        };
+
+        for (auto& toplevel : layer_manager.get_stacking_order(ALL_LAYERS))
+        {
+            bool toplevel_added = false;
+            for (auto& view : toplevel->enumerate_views())
+            {
+                add_entry(view, toplevel, true);
+                toplevel_added |= (view == toplevel);
+            }
+
+            /* Unmapped toplevels are not considered for input, but they are
+             * still on some workspaces */
+            if (!toplevel_added)
+            {
+                add_entry(toplevel, toplevel, false);
+            }
+        }
+
+        /* The entries left in old are destroyed at the end of this function,
+         * so their addresses cannot be reused by new entries yet */
+        bool order_changed = (old_order.size() != entries.size());
+        for (size_t i = 0; !order_changed && i < entries.size(); i++)
+        {
+            order_changed = (old_order[i] != entries[i].get());
+        }
+
+        /* Drop the destroyed entries, and add the new ones, which start
+         * dirty */
+        dirty_entries.clear();
+        for (auto& entry : entries)
+        {
+            if (entry->dirty)
+            {
+                dirty_entries.push_back(entry.get());
+            }
+        }
+
+        if (order_changed || toplevels_changed)
+        {
+            cells_dirty = true;
+        }
+
+        if (order_changed || toplevels_changed || attributes_changed)
+        {
+            bump_serial();
+        }
+
+        synced_generation = layer_manager.get_generation();
+        views_changed     = false;
+    }
+
+    static void insert_index(std::vector<uint32_t>& indices, uint32_t index)
+    {
+        indices.insert(
+            std::lower_bound(indices.begin(), indices.end(), index), index);
+    }
+
+    static void erase_index(std::vector<uint32_t>& indices, uint32_t index)
+    {
+        auto it = std::lower_bound(indices.begin(), indices.end(), index);
+        if ((it != indices.end()) && (*it == index))
+        {
+            indices.erase(it);
+        }
+    }
+
+    /** Add the entry to the cells its box overlaps, keeping them sorted */
+    void add_to_cells(entry_t *entry)
+    {
+        if (entry->sticky && (entry->view == entry->toplevel))
+        {
+            insert_index(sticky_entries, entry->index);
+        }
+
+        int x1, y1, x2, y2;
+        if (!get_cell_range(entry->box + grid_offset, x1, y1, x2, y2))
+        {
+            return;
+        }
+
+        for (int x = x1; x <= x2; x++)
+        {
+            for (int y = y1; y <= y2; y++)
+            {
+                insert_index(cells[y * grid_size.width + x], entry->index);
+            }
+        }
+    }
+
+    /** Remove the entry from the cells, with the box it was added with */
+    void remove_from_cells(entry_t *entry)
+    {
+        if (entry->sticky && (entry->view == entry->toplevel))
+        {
+            erase_index(sticky_entries, entry->index);
+        }
+
+        int x1, y1, x2, y2;
+        if (!get_cell_range(entry->box + grid_offset, x1, y1, x2, y2))
+        {
+            return;
+        }
+
+        for (int x = x1; x <= x2; x++)
+        {
+            for (int y = y1; y <= y2; y++)
+            {
+                erase_index(cells[y * grid_size.width + x], entry->index);
+            }
+        }
+    }
+
+    /**
+     * Recompute the boxes of dirty entries. Unless all cells are going to be
+     * rebuilt, the cells of the entries whose box changed are updated.
+     */
+    void update_boxes()
+    {
+        for (auto entry : dirty_entries)
+        {
+            auto view = entry->view;
+            auto box  = get_view_extents(view);
+            if ((box != entry->box) || (view->sticky != entry->sticky))
+            {
+                if (!cells_dirty)
+                {
+                    remove_from_cells(entry);
+                }
+
+                entry->box    = box;
+                entry->sticky = view->sticky;
+                if (!cells_dirty)
+                {
+                    add_to_cells(entry);
+                }
+
+                bump_serial();
+            }
+
+            entry->dirty = false;
+        }
+
+        dirty_entries.clear();
+    }
+
+    /** Check whether the grid changed, in which case all cells are rebuilt */
+    void update_grid()
+    {
+        auto screen = output->get_screen_size();
+        auto grid   = output->workspace->get_workspace_grid_size();
+        auto cws    = output->workspace->get_current_workspace();
+
+        wf::dimensions_t new_cell_size = {
+            std::max(1, (screen.width + CELLS_PER_WORKSPACE - 1) /
+                CELLS_PER_WORKSPACE),
+            std::max(1, (screen.height + CELLS_PER_WORKSPACE - 1) /
+                CELLS_PER_WORKSPACE),
+        };
+        wf::dimensions_t new_grid_size = {
+            grid.width * CELLS_PER_WORKSPACE,
+            grid.height * CELLS_PER_WORKSPACE,
+        };
+        wf::point_t new_offset = {cws.x * screen.width, cws.y * screen.height};
+
+        if ((new_cell_size != cell_size) || (new_grid_size != grid_size) ||
+            (new_offset != grid_offset))
+        {
+            cell_size   = new_cell_size;
+            grid_size   = new_grid_size;
+            grid_offset = new_offset;
+            cells_dirty = true;
+            bump_serial();
+        }
+    }
+
+    void rebuild_cells()
+    {
+        if (!cells_dirty)
+        {
+            return;
+        }
+
+        cells.resize(grid_size.width * grid_size.height);
+        for (auto& cell : cells)
+        {
+            cell.clear();
+        }
+
+        sticky_entries.clear();
+        for (auto& entry : entries)
+        {
+            add_to_cells(entry.get());
+        }
+
+        cells_dirty = false;
+    }
+
+    /**
+     * Get the range of cells which the given box in grid coordinates overlaps.
+     * @return false if the box is empty or outside of the grid.
+     */
+    bool get_cell_range(wf::geometry_t box, int& x1, int& y1, int& x2, int& y2)
+    {
+        if ((box.width <= 0) || (box.height <= 0))
+        {
+            return false;
+        }
+
+        x1 = std::max(0, floor_div(box.x, cell_size.width));
+        y1 = std::max(0, floor_div(box.y, cell_size.height));
+        x2 = std::min(grid_size.width - 1,
+            floor_div(box.x + box.width - 1, cell_size.width));
+        y2 = std::min(grid_size.height - 1,
+            floor_div(box.y + box.height - 1, cell_size.height));
+
+        return x1 <= x2 && y1 <= y2;
+    }
+
+    void refresh()
+    {
+        if (views_changed ||
+            (synced_generation != layer_manager.get_generation()))
+        {
+            synchronize();
+        }
+
+        /* The grid is checked first, so that boxes are moved between cells
+         * only if the cells are up to date with the current grid */
+        update_grid();
+        update_boxes();
+        rebuild_cells();
+    }
+
+  public:
+    output_view_index_t(output_t *output, output_layer_manager_t& layer_manager) :
+        output(output), layer_manager(layer_manager)
+    {
+        output->connect_signal("view-mapped", &on_view_mapped);
+        output->connect_signal("view-unmapped", &on_view_mapped);
+    }
+
+    /**
+     * @return The views in the given layers whose bounding box contains the
+     *   point, in output-local coordinates. The views are ordered like in
+     *   input_surface_at(): toplevels in stacking order, each preceded by its
+     *   child views.
+     */
+    std::vector<wayfire_view> get_views_at(wf::pointf_t point,
+        uint32_t layers_mask)
+    {
+        refresh();
+
+        std::vector<wayfire_view> views;
+        wf::geometry_t point_box = {(int)std::floor(point.x),
+            (int)std::floor(point.y), 1, 1};
+
+        int x1, y1, x2, y2;
+        if (!get_cell_range(point_box + grid_offset, x1, y1, x2, y2))
+        {
+            return views;
+        }
+
+        for (auto i : cells[y1 * grid_size.width + x1])
+        {
+            auto& entry = entries[i];
+            if (entry->input && (entry->layer & layers_mask) &&
+                (entry->box & point))
+            {
+                views.push_back(entry->view);
+            }
+        }
+
+        return views;
+    }
+
+    /**
+     * @return A serial which changes whenever views are mapped, unmapped or
+     *   restacked, or the box of a view changes. Results of get_views_at() stay
+     *   valid while the serial does not change.
+     */
+    uint64_t get_serial()
+    {
+        refresh();
+        return serial;
+    }
+
+    /**
+     * @return The part of the box, in output-local coordinates, where
+     *   get_views_at() would not return any view before the given one.
+     *   Empty if the view is not considered for input.
+     */
+    wf::region_t get_exposed_region(wayfire_view view, wf::geometry_t box,
+        uint32_t layers_mask)
+    {
+        refresh();
+
+        wf::region_t exposed;
+        auto it = std::find_if(entries.begin(), entries.end(), [&] (auto& entry)
+        {
+            return entry->view == view;
+        });
+        int x1, y1, x2, y2;
+        if ((it == entries.end()) || !(*it)->input ||
+            !((*it)->layer & layers_mask) ||
+            !get_cell_range(box + grid_offset, x1, y1, x2, y2))
+        {
+            return exposed;
+        }
+
+        /* Points outside of the cells have no views at all */
+        wf::geometry_t cells_box = {
+            x1 * cell_size.width - grid_offset.x,
+            y1 * cell_size.height - grid_offset.y,
+            (x2 - x1 + 1) * cell_size.width,
+            (y2 - y1 + 1) * cell_size.height,
+        };
+        exposed |= wf::geometry_intersection(box, cells_box);
+
+        uint32_t view_index = it - entries.begin();
+        std::vector<uint32_t> indices;
+        for (int x = x1; x <= x2; x++)
+        {
+            for (int y = y1; y <= y2; y++)
+            {
+                for (auto i : cells[y * grid_size.width + x])
+                {
+                    if (i < view_index)
+                    {
+                        indices.push_back(i);
+                    }
+                }
+            }
+        }
+
+        std::sort(indices.begin(), indices.end());
+        indices.erase(std::unique(indices.begin(), indices.end()), indices.end());
+        for (auto i : indices)
+        {
+            auto& entry = entries[i];
+            if (entry->input && (entry->layer & layers_mask))
+            {
+                exposed ^= entry->box;
+            }
+        }
+
+        return exposed;
+    }
+
+    /**
+     * @return The toplevel views in the given layers, in stacking order, whose
+     *   box intersects the given workspace, or which are sticky. This is a
+     *   superset of the views visible on the workspace.
+     */
+    std::vector<wayfire_view> get_views_near_workspace(wf::point_t ws,
+        uint32_t layers_mask)
+    {
+        refresh();
+
+        auto screen = output->get_screen_size();
+        wf::geometry_t ws_box = {ws.x * screen.width, ws.y * screen.height,
+            screen.width, screen.height};
+
+        std::vector<uint32_t> indices = sticky_entries;
+        int x1, y1, x2, y2;
+        if (get_cell_range(ws_box, x1, y1, x2, y2))
+        {
+            for (int x = x1; x <= x2; x++)
+            {
+                for (int y = y1; y <= y2; y++)
+                {
+                    auto& cell = cells[y * grid_size.width + x];
+                    indices.insert(indices.end(), cell.begin(), cell.end());
+                }
+            }
+        } else
+        {
+            /* Not a workspace in the grid, consider all views */
+            for (uint32_t i = 0; i < entries.size(); i++)
+            {
+                indices.push_back(i);
+            }
+        }
+
+        std::sort(indices.begin(), indices.end());
+        indices.erase(std::unique(indices.begin(), indices.end()), indices.end());
+
+        std::vector<wayfire_view> views;
+        for (auto i : indices)
+        {
+            auto& entry = entries[i];
+            if ((entry->view == entry->toplevel) && (entry->layer & layers_mask))
+            {
+                views.push_back(entry->view);
+            }
+        }
+
+        return views;
+    }
+};
+
 struct default_workspace_implementation_t : public workspace_implementation_t
 {
     bool view_movable(wayfire_view view)
@@ -417,9 +1081,11 @@ class output_viewport_manager_t
     int current_vy;
 
     output_t *output;
+    output_view_index_t& view_index;
 
   public:
-    output_viewport_manager_t(output_t *output)
+    output_viewport_manager_t(output_t *output, output_view_index_t& view_index) :
+        view_index(view_index)
     {
         this->output = output;
         vwidth  = wf::option_wrapper_t<int>("core/vwidth");
@@ -445,32 +1111,58 @@ class output_viewport_manager_t
         wf::geometry_t workspace_relative_geometry;
         wlr_box view_bbox = view->get_bounding_box();
 
-        for (int horizontal = 0; horizontal < this->vwidth; horizontal++)
+        for (auto ws : get_view_workspace_range(view))
         {
-            for (int vertical = 0; vertical < this->vheight; vertical++)
+            if (output->workspace->view_visible_on(view, ws))
             {
-                wf::point_t ws = {horizontal, vertical};
-                if (output->workspace->view_visible_on(view, ws))
-                {
-                    workspace_relative_geometry = output->render->get_ws_box(ws);
-                    auto intersection = wf::geometry_intersection(
-                        view_bbox, workspace_relative_geometry);
-                    double area = 1.0 * intersection.width * intersection.height;
-                    area /= 1.0 * view_bbox.width * view_bbox.height;
+                workspace_relative_geometry = output->render->get_ws_box(ws);
+                auto intersection = wf::geometry_intersection(
+                    view_bbox, workspace_relative_geometry);
+                double area = 1.0 * intersection.width * intersection.height;
+                area /= 1.0 * view_bbox.width * view_bbox.height;
 
-                    if (area < threshold)
-                    {
-                        continue;
-                    }
-
-                    view_workspaces.push_back(ws);
+                if (area < threshold)
+                {
+                    continue;
                 }
+
+                view_workspaces.push_back(ws);
             }
         }
 
         return view_workspaces;
     }
 
+    workspace_range_t get_workspace_range(wf::geometry_t box)
+    {
+        workspace_range_t range;
+        if ((box.width <= 0) || (box.height <= 0))
+        {
+            return range;
+        }
+
+        auto screen = output->get_screen_size();
+        range.first.x = std::max(0, current_vx + floor_div(box.x, screen.width));
+        range.first.y = std::max(0, current_vy + floor_div(box.y, screen.height));
+        range.last.x  = std::min(vwidth - 1,
+            current_vx + floor_div(box.x + box.width - 1, screen.width));
+        range.last.y = std::min(vheight - 1,
+            current_vy + floor_div(box.y + box.height - 1, screen.height));
+
+        return range;
+    }
+
+    workspace_range_t get_view_workspace_range(wayfire_view view)
+    {
+        if (view->sticky)
+        {
+            /* Sticky views are on all workspaces */
+            return {{0, 0}, {vwidth - 1, vheight - 1}};
+        }
+
+        return get_workspace_range(get_view_extents(view));
+    }
+
     /**
      * @param use_bbox When considering view visibility, whether to use the
      *        bounding box or the wm geometry.
@@ -541,9 +1233,8 @@ class output_viewport_manager_t
     std::vector<wayfire_view> get_views_on_workspace(wf::point_t vp,
         uint32_t layers_mask)
     {
-        /* get all views in the given layers */
-        std::vector<wayfire_view> views =
-            output->workspace->get_views_in_layer(layers_mask);
+        /* get the views in the given layers which may be on the workspace */
+        auto views = view_index.get_views_near_workspace(vp, layers_mask);
 
         /* remove those which aren't visible on the workspace */
         auto it = std::remove_if(views.begin(), views.end(), [&] (wayfire_view view)
@@ -834,12 +1525,14 @@ class workspace_manager::impl
 
   public:
     output_layer_manager_t layer_manager;
+    output_view_index_t view_index;
     output_viewport_manager_t viewport_manager;
     output_workarea_manager_t workarea_manager;
 
     impl(output_t *o) :
         layer_manager(),
-        viewport_manager(o),
+        view_index(o, layer_manager),
+        viewport_manager(o, view_index),
         workarea_manager(o)
     {
         output = o;
@@ -918,33 +1611,56 @@ class workspace_manager::impl
     {
         stack_order_changed_signal data;
         data.output = output;
-        output->emit_signal("stack-order-changed", &data);
-        wf::get_core().emit_signal("output-stack-order-changed", &data);
+        static const signal_id_t stack_order_changed{"stack-order-changed"};
+        static const signal_id_t output_stack_order_changed{
+            "output-stack-order-changed"};
+        output->emit_signal(stack_order_changed, &data);
+        wf::get_core().emit_signal(output_stack_order_changed, &data);
     }
 
     void update_promoted_views()
     {
         auto vp = viewport_manager.get_current_workspace();
-        auto already_promoted = viewport_manager.get_promoted_views(vp);
-        for (auto& view : already_promoted)
-        {
-            view->view_impl->is_promoted = false;
-        }
 
-        auto views = viewport_manager.get_views_on_workspace(
-            vp, LAYER_WORKSPACE);
+        /* Pick the candidate from the order the views would have without any
+         * promotion, so that the cached stacking order does not need to be
+         * invalidated just to find it. */
+        auto views = layer_manager.get_views_ignoring_promotion(LAYER_WORKSPACE);
 
         /* Do not consider unmapped views or views which are not visible */
         auto it = std::remove_if(views.begin(), views.end(),
-            [] (wayfire_view view) -> bool
+            [&] (wayfire_view view) -> bool
         {
-            return !view->is_mapped() || !view->is_visible();
+            return !view->is_mapped() || !view->is_visible() ||
+                !viewport_manager.view_visible_on(view, vp);
         });
         views.erase(it, views.end());
 
+        wayfire_view promoted = nullptr;
         if (!views.empty() && views.front()->fullscreen)
         {
-            views.front()->view_impl->is_promoted = true;
+            promoted = views.front();
+        }
+
+        bool changed = false;
+        for (auto& view : viewport_manager.get_promoted_views(vp))
+        {
+            if (view != promoted)
+            {
+                view->view_impl->is_promoted = false;
+                changed = true;
+            }
+        }
+
+        if (promoted && !promoted->view_impl->is_promoted)
+        {
+            promoted->view_impl->is_promoted = true;
+            changed = true;
+        }
+
+        if (changed)
+        {
+            layer_manager.invalidate_stacking_order();
         }
 
         check_autohide_panels();
@@ -1075,6 +1791,16 @@ workspace_manager::workspace_manager(output_t *wo) : pimpl(new impl(wo))
 workspace_manager::~workspace_manager() = default;
 
 /* Just pass to the appropriate function from above */
+workspace_range_t workspace_manager::get_workspace_range(wf::geometry_t box)
+{
+    return pimpl->viewport_manager.get_workspace_range(box);
+}
+
+workspace_range_t workspace_manager::get_view_workspace_range(wayfire_view view)
+{
+    return pimpl->viewport_manager.get_view_workspace_range(view);
+}
+
 std::vector<wf::point_t> workspace_manager::get_view_workspaces(wayfire_view view,
     double threshold)
 {
@@ -1092,6 +1818,23 @@ std::vector<wayfire_view> workspace_manager::get_views_on_workspace(wf::point_t
     return pimpl->viewport_manager.get_views_on_workspace(ws, layer_mask);
 }
 
+std::vector<wayfire_view> workspace_manager::get_views_at(wf::pointf_t point,
+    uint32_t layers_mask)
+{
+    return pimpl->view_index.get_views_at(point, layers_mask);
+}
+
+wf::region_t workspace_manager::get_exposed_region(wayfire_view view,
+    wf::geometry_t box, uint32_t layers_mask)
+{
+    return pimpl->view_index.get_exposed_region(view, box, layers_mask);
+}
+
+uint64_t workspace_manager::get_views_serial()
+{
+    return pimpl->view_index.get_serial();
+}
+
 std::vector<wayfire_view> workspace_manager::get_views_on_workspace_sublayer(
     wf::point_t ws, nonstd::observer_ptr<sublayer_t> sublayer)
 {
@@ -1155,6 +1898,11 @@ std::vector<wayfire_view> workspace_manager::get_views_in_layer(uint32_t layers_
     return pimpl->layer_manager.get_views_in_layer(layers_mask);
 }
 
+stacking_order_t workspace_manager::get_stacking_order(uint32_t layers_mask)
+{
+    return pimpl->layer_manager.get_stacking_order(layers_mask);
+}
+
 std::vector<wayfire_view> workspace_manager::get_views_in_sublayer(
     nonstd::observer_ptr<sublayer_t> sublayer)
 {
@@ -3,6 +3,7 @@
 #include <wayfire/opengl.hpp>
 #include <wayfire/compositor-view.hpp>
 #include <wayfire/signal-definitions.hpp>
+#include "view-impl.hpp"
 #include <cstring>
 
 #include <glm/gtc/matrix_transform.hpp>
@@ -103,7 +104,8 @@ void wf::mirror_view_t::move(int x, int y)
     this->y = y;
 
     damage();
-    emit_signal("geometry-changed", &data);
+    static const signal_id_t geometry_changed{"geometry-changed"};
+    emit_view_signal(self(), geometry_changed, &data);
 }
 
 wf::geometry_t wf::mirror_view_t::get_output_geometry()
@@ -245,7 +247,8 @@ void wf::color_rect_view_t::move(int x, int y)
     this->geometry.y = y;
 
     damage();
-    emit_signal("geometry-changed", &data);
+    static const signal_id_t geometry_changed{"geometry-changed"};
+    emit_view_signal(self(), geometry_changed, &data);
 }
 
 void wf::color_rect_view_t::resize(int w, int h)
@@ -258,7 +261,8 @@ void wf::color_rect_view_t::resize(int w, int h)
     this->geometry.height = h;
 
     damage();
-    emit_signal("geometry-changed", &data);
+    static const signal_id_t geometry_changed{"geometry-changed"};
+    emit_view_signal(self(), geometry_changed, &data);
 }
 
 wf::geometry_t wf::color_rect_view_t::get_output_geometry()
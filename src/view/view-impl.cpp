@@ -130,11 +130,13 @@ void wf::wlr_view_t::set_position(int x, int y,
 
     if (send_signal)
     {
-        emit_signal("geometry-changed", &data);
-        wf::get_core().emit_signal("view-geometry-changed", &data);
+        static const signal_id_t geometry_changed{"geometry-changed"};
+        static const signal_id_t view_geometry_changed{"view-geometry-changed"};
+        emit_view_signal(self(), geometry_changed, &data);
+        wf::get_core().emit_signal(view_geometry_changed, &data);
         if (get_output())
         {
-            get_output()->emit_signal("view-geometry-changed", &data);
+            get_output()->emit_signal(view_geometry_changed, &data);
         }
     }
 
@@ -194,11 +196,13 @@ void wf::wlr_view_t::update_size()
     /* Damage new size */
     last_bounding_box = get_bounding_box();
     view_damage_raw(self(), last_bounding_box);
-    emit_signal("geometry-changed", &data);
-    wf::get_core().emit_signal("view-geometry-changed", &data);
+    static const signal_id_t geometry_changed{"geometry-changed"};
+    static const signal_id_t view_geometry_changed{"view-geometry-changed"};
+    emit_view_signal(self(), geometry_changed, &data);
+    wf::get_core().emit_signal(view_geometry_changed, &data);
     if (get_output())
     {
-        get_output()->emit_signal("view-geometry-changed", &data);
+        get_output()->emit_signal(view_geometry_changed, &data);
     }
 
     if (view_impl->frame)
@@ -1,6 +1,7 @@
 #ifndef VIEW_IMPL_HPP
 #define VIEW_IMPL_HPP
 
+#include <list>
 #include <wayfire/nonstd/safe-list.hpp>
 #include <wayfire/view.hpp>
 #include <wayfire/opengl.hpp>
@@ -77,6 +78,9 @@ class view_interface_t::view_priv_impl
 
     /** The sublayer of the view. For workspace-manager. */
     nonstd::observer_ptr<sublayer_t> sublayer;
+    /** The position of the view in the sublayer, valid if sublayer is set.
+     * For workspace-manager. */
+    std::list<wayfire_view>::iterator sublayer_position;
     /* Promoted to the fullscreen layer? For workspace-manager. */
     bool is_promoted = false;
 
@@ -229,6 +233,18 @@ class wlr_view_t :
     }
 };
 
+/**
+ * Emit a signal on the view both by name and as a typed signal. Signals with
+ * typed listeners must always be emitted with this, so that listeners of
+ * either kind see every emission.
+ */
+template<class T>
+void emit_view_signal(wayfire_view view, const signal_id_t& signal, T *data)
+{
+    view->emit_signal(signal, data);
+    view->emit(data);
+}
+
 /** Emit the map signal for the given view */
 void emit_view_map_signal(wayfire_view view, bool has_position);
 void emit_ping_timeout_signal(wayfire_view view);
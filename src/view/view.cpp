@@ -197,7 +197,7 @@ void wf::view_interface_t::set_output(wf::output_t *new_output)
         get_output()->emit_signal("view-detached", &data);
     }
 
-    _output_signal data;
+    view_set_output_signal data;
     data.output = get_output();
 
     surface_interface_t::set_output(new_output);
@@ -208,7 +208,8 @@ void wf::view_interface_t::set_output(wf::output_t *new_output)
         get_output()->emit_signal("view-attached", &data);
     }
 
-    emit_signal("set-output", &data);
+    static const signal_id_t set_output_signal{"set-output"};
+    emit_view_signal(self(), set_output_signal, &data);
 
     for (auto& view : this->children)
     {
@@ -1303,13 +1304,35 @@ void wf::view_damage_raw(wayfire_view view, const wlr_box& box)
          * This prevents hidden panels from spilling damage onto other workspaces */
         wlr_box ws_box = output->get_relative_geometry();
         wlr_box visible_damage = geometry_intersection(box, ws_box);
-        for (int i = 0; i < wsize.width; i++)
+        if ((visible_damage.width > 0) && (visible_damage.height > 0))
         {
-            for (int j = 0; j < wsize.height; j++)
+            /* Copies of damage spanning the whole output width or height are
+             * adjacent, so they can be merged into a single box spanning the
+             * whole grid in that direction */
+            int columns = wsize.width;
+            int rows    = wsize.height;
+            if (visible_damage.width == ws_box.width)
             {
-                const int dx = (i - cws.x) * ws_box.width;
-                const int dy = (j - cws.y) * ws_box.height;
-                output->render->damage(visible_damage + wf::point_t{dx, dy});
+                visible_damage.width *= columns;
+                columns = 1;
+            }
+
+            if (visible_damage.height == ws_box.height)
+            {
+                visible_damage.height *= rows;
+                rows = 1;
+            }
+
+            for (int i = 0; i < columns; i++)
+            {
+                for (int j = 0; j < rows; j++)
+                {
+                    /* i/j is 0 for merged directions, so the box starts on the
+                     * first workspace */
+                    const int dx = (i - cws.x) * ws_box.width;
+                    const int dy = (j - cws.y) * ws_box.height;
+                    output->render->damage(visible_damage + wf::point_t{dx, dy});
+                }
             }
         }
     } else
@@ -1317,7 +1340,9 @@ void wf::view_damage_raw(wayfire_view view, const wlr_box& box)
         output->render->damage(box);
     }
 
-    view->emit_signal("region-damaged", nullptr);
+    /* Emitted on every damage, so avoid looking up the name each time */
+    static const wf::signal_id_t region_damaged{"region-damaged"};
+    view->emit_signal(region_damaged, nullptr);
 }
 
 void wf::view_interface_t::destruct()